@@ -0,0 +1,433 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Add TFTGL library
+#include <tftgl.h>
+
+// Add NANOVG library
+#include <nanovg.h>
+#define NANOVG_GLES2_IMPLEMENTATION	// Use GLES 2 implementation.
+#include <nanovg_gl.h>
+
+// Benchmark of the tftgl hot paths. Every case is run a few times to warm
+// up (caches, GL shader compilation, lazy allocations) and then timed per
+// iteration. Results are printed as CSV (default) or JSON, one row per case.
+//
+// Usage: bench [--json] [--headless] [--iterations N] [--font FILE] [--driver NAME]
+
+#define BENCH_WARMUP 5
+#define BENCH_MAX_ITERATIONS 10000
+#define BENCH_MAX_RESULTS 64
+
+typedef struct {
+	char name[32];
+	char param[32];
+	unsigned int iterations;
+	double min, p50, p90, p99, max, mean; // Microseconds
+	double pixelsPerSec; // Zero if not a pixel case
+	double conversionsPerSec; // Of the touch sensor, zero if not a touch case
+} BenchResult;
+
+static BenchResult results[BENCH_MAX_RESULTS];
+static unsigned int resultCount = 0;
+static double samples[BENCH_MAX_ITERATIONS];
+static unsigned int iterations = 100;
+static unsigned int headless = 0;
+static unsigned int flags = TFTGL_LANDSCAPE;
+static const char* fontFile = "examples/FreeSans.ttf";
+
+static double benchMicros(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static int compareDouble(const void* a, const void* b){
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+static double percentile(const double* sorted, unsigned int n, double p){
+	unsigned int i = (unsigned int)(p * (n - 1) + 0.5);
+	return sorted[i];
+}
+
+// Sorts the samples and adds a result row. The pixels is the number of
+// pixels processed by one iteration (zero if not relevant). Returns the
+// row, or NULL if there is no room left.
+static BenchResult* benchReport(const char* name, const char* param, unsigned int n, unsigned long pixels){
+	BenchResult* r;
+	unsigned int i;
+	double sum = 0;
+
+	if(resultCount >= BENCH_MAX_RESULTS || n == 0)return NULL;
+	r = &results[resultCount++];
+	memset(r, 0, sizeof(BenchResult));
+
+	qsort(samples, n, sizeof(double), compareDouble);
+	for(i = 0; i < n; i++)sum += samples[i];
+
+	snprintf(r->name, sizeof(r->name), "%s", name);
+	snprintf(r->param, sizeof(r->param), "%s", param);
+	r->iterations = n;
+	r->min = samples[0];
+	r->p50 = percentile(samples, n, 0.50);
+	r->p90 = percentile(samples, n, 0.90);
+	r->p99 = percentile(samples, n, 0.99);
+	r->max = samples[n - 1];
+	r->mean = sum / n;
+	r->pixelsPerSec = (pixels > 0 && r->p50 > 0 ? pixels / (r->p50 / 1000000.0) : 0);
+	return r;
+}
+
+// Pixel patterns: flat color (every pixel is a run) and noise (no runs)
+static unsigned char* makePixels(unsigned int w, unsigned int h, unsigned int noise){
+	unsigned char* pixels = (unsigned char*)malloc(w * h * 3);
+	unsigned int i, seed = 12345;
+	if(pixels == NULL)return NULL;
+	for(i = 0; i < w * h * 3; i++){
+		seed = seed * 1103515245 + 12345;
+		pixels[i] = (noise ? (seed >> 16) & 0xFF : 0x80);
+	}
+	return pixels;
+}
+
+static void benchFill(){
+	unsigned int width = tftglGetWidth();
+	unsigned int height = tftglGetHeight();
+	unsigned long area = (unsigned long)width * height;
+	static const unsigned char color[3] = {0, 128, 255};
+	unsigned int i, noise;
+
+	for(i = 0; i < BENCH_WARMUP + iterations; i++){
+		double start = benchMicros();
+		tftglFillColor(0, 0, width, height, color);
+		if(i >= BENCH_WARMUP)samples[i - BENCH_WARMUP] = benchMicros() - start;
+	}
+	benchReport("fill_color", "full", iterations, area);
+
+	for(noise = 0; noise < 2; noise++){
+		unsigned char* pixels = makePixels(width, height, noise);
+		if(pixels == NULL)return;
+		for(i = 0; i < BENCH_WARMUP + iterations; i++){
+			double start = benchMicros();
+			tftglFillPixels(0, 0, width, height, pixels);
+			if(i >= BENCH_WARMUP)samples[i - BENCH_WARMUP] = benchMicros() - start;
+		}
+		benchReport("fill_pixels", noise ? "noise" : "flat", iterations, area);
+		free(pixels);
+	}
+}
+
+// Bottom to top rows (as read from GL) streamed in memory order with the
+// flipped address mode, against walking the rows backwards (TFTGL_BOTTOM_UP).
+// Needs to init the library again with and without the flag.
+static unsigned int benchRowOrder(){
+	unsigned int order, i;
+	unsigned int width = tftglGetWidth();
+	unsigned int height = tftglGetHeight();
+	unsigned long area = (unsigned long)width * height;
+	unsigned char* pixels = makePixels(width, height, 1);
+	if(pixels == NULL)return TFTGL_OK;
+
+	for(order = 0; order < 2; order++){
+		const char* param = (order ? "bottom_up" : "top_down");
+		tftglTerminate();
+		if(tftglInit(flags | (order ? TFTGL_BOTTOM_UP : 0)) != TFTGL_OK)break;
+
+		for(i = 0; i < BENCH_WARMUP + iterations; i++){
+			double start = benchMicros();
+			tftglFillPixels(0, 0, width, height, pixels);
+			if(i >= BENCH_WARMUP)samples[i - BENCH_WARMUP] = benchMicros() - start;
+		}
+		benchReport("row_order", param, iterations, area);
+
+		for(i = 0; i < BENCH_WARMUP + iterations; i++){
+			double start = benchMicros();
+			tftglFillPixels565(0, 0, width, height, (const unsigned short*)pixels);
+			if(i >= BENCH_WARMUP)samples[i - BENCH_WARMUP] = benchMicros() - start;
+		}
+		benchReport("row_order_565", param, iterations, area);
+	}
+	free(pixels);
+
+	tftglTerminate();
+	return tftglInit(flags);
+}
+
+static void benchUpload(){
+	static const unsigned int sizes[][2] = {
+		{16, 16}, {64, 64}, {200, 120}, {400, 240}, {0, 0} // Zero is full screen
+	};
+	unsigned int s, i;
+	char param[32];
+
+	for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++){
+		unsigned int w = (sizes[s][0] ? sizes[s][0] : tftglGetWidth());
+		unsigned int h = (sizes[s][1] ? sizes[s][1] : tftglGetHeight());
+		double reads[BENCH_MAX_ITERATIONS];
+		TftglStats stats;
+
+		for(i = 0; i < BENCH_WARMUP + iterations; i++){
+			// New content every time, so nothing can be skipped
+			glClearColor((i % 7) / 7.0f, (i % 5) / 5.0f, (i % 3) / 3.0f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
+			glFinish();
+
+			tftglGetStats(NULL);
+			double start = benchMicros();
+			tftglUploadFboArea(0, 0, w, h);
+			double end = benchMicros();
+			tftglGetStats(&stats);
+			if(i >= BENCH_WARMUP){
+				samples[i - BENCH_WARMUP] = end - start;
+				reads[i - BENCH_WARMUP] = stats.readMicros;
+			}
+		}
+
+		snprintf(param, sizeof(param), "%ux%u", w, h);
+		benchReport("upload_area", param, iterations, (unsigned long)w * h);
+
+		// The part of it spent reading the pixels back
+		memcpy(samples, reads, iterations * sizeof(double));
+		benchReport("upload_area_read", param, iterations, 0);
+	}
+}
+
+// NanoVG scenes, the nano.c graph, a screen of text and many rounded rects
+static void sceneGraph(struct NVGcontext* vg, float width, float height){
+	static const double graphSamples[6] = {0.2, 0.4, 0.45, 0.6, 0.7, 0.5};
+	unsigned int i;
+	NVGpaint bg = nvgLinearGradient(vg, 0, height * 0.2, 0, height, nvgRGBA(0,160,192,0), nvgRGBA(0,160,192,192));
+
+	nvgBeginPath(vg);
+	nvgMoveTo(vg, 0, height / 2);
+	for(i = 0; i < 6; i++){
+		nvgLineTo(vg, (width / 6) * (i + 1), height * graphSamples[i]);
+	}
+	nvgLineTo(vg, width, height);
+	nvgLineTo(vg, 0, height);
+	nvgFillPaint(vg, bg);
+	nvgFill(vg);
+
+	nvgBeginPath(vg);
+	nvgMoveTo(vg, 0, height / 2);
+	for(i = 0; i < 6; i++){
+		nvgLineTo(vg, (width / 6) * (i + 1), height * graphSamples[i]);
+	}
+	nvgStrokeColor(vg, nvgRGBA(0, 160, 192, 255));
+	nvgStrokeWidth(vg, 3.0f);
+	nvgStroke(vg);
+
+	nvgBeginPath(vg);
+	for(i = 0; i < 6; i++){
+		nvgCircle(vg, (width / 6) * (i + 1), height * graphSamples[i], 4.0);
+	}
+	nvgFillColor(vg, nvgRGBA(0, 160, 192, 255));
+	nvgFill(vg);
+}
+
+static void sceneText(struct NVGcontext* vg, float width, float height){
+	float y;
+	nvgFontFace(vg, "sans");
+	nvgFontSize(vg, 16);
+	nvgFillColor(vg, nvgRGBA(255, 255, 255, 255));
+	for(y = 16; y < height; y += 18){
+		nvgText(vg, 4, y, "The quick brown fox jumps over the lazy dog 0123456789 !?", NULL);
+	}
+	(void)width;
+}
+
+static void sceneRects(struct NVGcontext* vg, float width, float height){
+	unsigned int i;
+	for(i = 0; i < 500; i++){
+		float x = (i * 37) % (unsigned int)(width - 40);
+		float y = (i * 53) % (unsigned int)(height - 30);
+		nvgBeginPath(vg);
+		nvgRoundedRect(vg, x, y, 40, 30, 6);
+		nvgFillColor(vg, nvgRGBA(i % 256, (i * 3) % 256, 200, 255));
+		nvgFill(vg);
+		nvgStrokeColor(vg, nvgRGBA(0, 0, 0, 255));
+		nvgStroke(vg);
+	}
+}
+
+static void benchNanovg(){
+	struct {
+		const char* name;
+		void (*draw)(struct NVGcontext* vg, float width, float height);
+	} scenes[] = {
+		{"graph", sceneGraph},
+		{"text", sceneText},
+		{"rounded_rects", sceneRects},
+	};
+	float width = tftglGetWidth();
+	float height = tftglGetHeight();
+	unsigned int s, i;
+	double gpu[BENCH_MAX_ITERATIONS];
+
+	struct NVGcontext* vg = nvgCreateGLES2(NVG_ANTIALIAS | NVG_STENCIL_STROKES);
+	if(vg == NULL){
+		fprintf(stderr, "Failed to create NanoVG context, skipping NanoVG cases\n");
+		return;
+	}
+	if(nvgCreateFont(vg, "sans", fontFile) < 0){
+		fprintf(stderr, "Failed to load font %s, skipping the text case\n", fontFile);
+	}
+
+	for(s = 0; s < sizeof(scenes) / sizeof(scenes[0]); s++){
+		if(strcmp(scenes[s].name, "text") == 0 && nvgFindFont(vg, "sans") < 0)continue;
+		for(i = 0; i < BENCH_WARMUP + iterations; i++){
+			glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+			glFinish();
+
+			// Frame build is the CPU side (tessellation and GL calls),
+			// the GL finish is the time to render it
+			double start = benchMicros();
+			nvgBeginFrame(vg, width, height, 1.0);
+			scenes[s].draw(vg, width, height);
+			nvgEndFrame(vg);
+			double built = benchMicros();
+			glFinish();
+			if(i >= BENCH_WARMUP){
+				samples[i - BENCH_WARMUP] = built - start;
+				gpu[i - BENCH_WARMUP] = benchMicros() - built;
+			}
+		}
+		benchReport("nvg_build", scenes[s].name, iterations, 0);
+		memcpy(samples, gpu, iterations * sizeof(double));
+		benchReport("nvg_render", scenes[s].name, iterations, 0);
+	}
+
+	nvgDeleteGLES2(vg);
+}
+
+// The conversions of the touch sensor per second, from the conversions
+// of one iteration and its median time
+static void benchConversions(BenchResult* r, unsigned long conversions){
+	if(r != NULL && r->p50 > 0){
+		r->conversionsPerSec = conversions / (r->p50 / 1000000.0);
+	}
+}
+
+static void benchTouch(){
+	unsigned int i, x, y, z;
+	TftglStats stats;
+	BenchResult* r;
+
+	tftglGetStats(NULL);
+	for(i = 0; i < BENCH_WARMUP + iterations; i++){
+		double start = benchMicros();
+		tftglGetTouch(&x, &y);
+		if(i >= BENCH_WARMUP)samples[i - BENCH_WARMUP] = benchMicros() - start;
+	}
+	tftglGetStats(&stats);
+	r = benchReport("touch", "get_touch", iterations, 0);
+	benchConversions(r, stats.touchConversions / (BENCH_WARMUP + iterations));
+
+	for(i = 0; i < BENCH_WARMUP + iterations; i++){
+		double start = benchMicros();
+		tftglGetTouchRaw(&x, &y, &z);
+		if(i >= BENCH_WARMUP)samples[i - BENCH_WARMUP] = benchMicros() - start;
+	}
+	tftglGetStats(&stats);
+	r = benchReport("touch", "get_touch_raw", iterations, 0);
+	benchConversions(r, stats.touchConversions / (BENCH_WARMUP + iterations));
+}
+
+static void printCsv(){
+	unsigned int i;
+	printf("name,param,iterations,min_us,p50_us,p90_us,p99_us,max_us,mean_us,pixels_per_s,conversions_per_s\n");
+	for(i = 0; i < resultCount; i++){
+		const BenchResult* r = &results[i];
+		printf("%s,%s,%u,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.0f,%.0f\n", r->name, r->param, r->iterations,
+			r->min, r->p50, r->p90, r->p99, r->max, r->mean, r->pixelsPerSec, r->conversionsPerSec);
+	}
+}
+
+static void printJson(){
+	unsigned int i;
+	printf("{\n\t\"renderer\": \"%s\",\n\t\"headless\": %s,\n\t\"results\": [\n",
+		(const char*)glGetString(GL_RENDERER), headless ? "true" : "false");
+	for(i = 0; i < resultCount; i++){
+		const BenchResult* r = &results[i];
+		printf("\t\t{\"name\": \"%s\", \"param\": \"%s\", \"iterations\": %u, "
+			"\"min_us\": %.1f, \"p50_us\": %.1f, \"p90_us\": %.1f, \"p99_us\": %.1f, "
+			"\"max_us\": %.1f, \"mean_us\": %.1f, \"pixels_per_s\": %.0f, \"conversions_per_s\": %.0f}%s\n",
+			r->name, r->param, r->iterations, r->min, r->p50, r->p90, r->p99, r->max, r->mean,
+			r->pixelsPerSec, r->conversionsPerSec, (i + 1 < resultCount ? "," : ""));
+	}
+	printf("\t]\n}\n");
+}
+
+//==============================================================================
+int main(int argv, char** argc){
+	unsigned int json = 0;
+	int i;
+
+	for(i = 1; i < argv; i++){
+		if(strcmp(argc[i], "--json") == 0){
+			json = 1;
+		} else if(strcmp(argc[i], "--headless") == 0){
+			headless = 1;
+		} else if(strcmp(argc[i], "--iterations") == 0 && i + 1 < argv){
+			iterations = atoi(argc[++i]);
+		} else if(strcmp(argc[i], "--font") == 0 && i + 1 < argv){
+			fontFile = argc[++i];
+		} else if(strcmp(argc[i], "--driver") == 0 && i + 1 < argv && strcmp(argc[i + 1], "ssd1963") == 0){
+			flags |= TFTGL_DRIVER_SSD1963;
+			i++;
+		} else if(strcmp(argc[i], "--driver") == 0 && i + 1 < argv && strcmp(argc[i + 1], "ili9341") == 0){
+			flags |= TFTGL_DRIVER_ILI9341;
+			i++;
+		} else if(strcmp(argc[i], "--driver") == 0 && i + 1 < argv && strcmp(argc[i + 1], "ili9486") == 0){
+			flags |= TFTGL_DRIVER_ILI9486;
+			i++;
+		} else if(strcmp(argc[i], "--driver") == 0 && i + 1 < argv && strcmp(argc[i + 1], "st7796") == 0){
+			flags |= TFTGL_DRIVER_ST7796;
+			i++;
+		} else {
+			fprintf(stderr, "Usage: %s [--json] [--headless] [--iterations N] [--font FILE] "
+				"[--driver ssd1963|ili9341|ili9486|st7796]\n", argc[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if(iterations < 1)iterations = 1;
+	if(iterations > BENCH_MAX_ITERATIONS)iterations = BENCH_MAX_ITERATIONS;
+
+	if(headless){
+		flags |= TFTGL_HEADLESS;
+	}
+	if(tftglInit(flags) != TFTGL_OK){
+		fprintf(stderr, "Failed to initialize TFTGL library! Error: %s\n",
+			tftglGetErrorStr());
+		return EXIT_FAILURE;
+	}
+
+	// The display and the touch screen do nothing in headless mode
+	if(!headless){
+		benchFill();
+		if(benchRowOrder() != TFTGL_OK){
+			fprintf(stderr, "Failed to initialize TFTGL library! Error: %s\n",
+				tftglGetErrorStr());
+			return EXIT_FAILURE;
+		}
+	}
+	benchUpload();
+	benchNanovg();
+	if(!headless){
+		benchTouch();
+	}
+
+	if(json){
+		printJson();
+	} else {
+		printCsv();
+	}
+
+	tftglTerminate();
+	return EXIT_SUCCESS;
+}
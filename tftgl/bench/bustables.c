@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+// Checks the data bus tables of tftglInitBusTables on the host. Every
+// 16-bit value (and every 8-bit one) is written once with LCD_BUS_WRITE
+// and once pin by pin, the way the bus was driven before the tables, into
+// a simulated GPIO level register, and both must leave the same levels.
+// The wiring has gaps and swapped pins so no bit lands where a shift
+// would put it, the other GPIO must keep their levels.
+//
+// Usage: bustables
+
+#define LCD_DATA_CONSECUTIVE 0
+#define LCD_D0 2
+#define LCD_D1 3
+#define LCD_D2 17
+#define LCD_D3 27
+#define LCD_D4 22
+#define LCD_D5 10
+#define LCD_D6 9
+#define LCD_D7 11
+#define LCD_D8 5
+#define LCD_D9 6
+#define LCD_D10 13
+#define LCD_D11 26
+#define LCD_D12 23
+#define LCD_D13 24
+#define LCD_D14 25
+#define LCD_D15 8
+
+#define GPIO_GPFSET0 0
+#define GPIO_GPFCLR0 1
+
+// Level register of GPIO 0 to 31 and the writes done to it
+static uint32_t gpioLevel;
+static unsigned int gpioWrites;
+
+static void gpioWrite(unsigned int reg, uint32_t value){
+	if(reg == GPIO_GPFSET0){
+		gpioLevel |= value;
+	} else {
+		gpioLevel &= ~value;
+	}
+	gpioWrites++;
+}
+
+#define GPIO_WRITE_REG(reg, value) gpioWrite(reg, value)
+#define GPIO_WRITE_PIN(pinnum, pinstate) \
+	GPIO_WRITE_REG((pinstate ? GPIO_GPFSET0 : GPIO_GPFCLR0), (1 << pinnum))
+
+// The bus code of the library, the very same code
+#include "../src/tftgl_bus.h"
+
+static void busWritePins(unsigned int value, unsigned int bits){
+	unsigned int bit;
+	for(bit = 0; bit < bits; bit++){
+		GPIO_WRITE_PIN(busPins[bit], value & (1 << bit));
+	}
+}
+
+// Other GPIO levels to start from, the data pins must not touch them
+static const uint32_t levels[3] = {0x00000000, 0xFFFFFFFF, 0xA5C3F00F};
+
+static unsigned int busCheck(unsigned int bits){
+	unsigned int value, i, fails = 0;
+	uint32_t expected;
+
+	for(value = 0; value < (1u << bits); value++){
+		for(i = 0; i < sizeof(levels) / sizeof(levels[0]); i++){
+			gpioLevel = levels[i];
+			busWritePins(value, bits);
+			expected = gpioLevel;
+
+			gpioLevel = levels[i];
+			gpioWrites = 0;
+			if(bits == 16){
+				LCD_BUS_WRITE(value);
+			} else {
+				LCD_BUS_WRITE8(value);
+			}
+
+			if(gpioLevel != expected || gpioWrites != 2){
+				if(fails < 10){
+					fprintf(stderr, "%u-bit value 0x%04X from 0x%08X: 0x%08X, expected 0x%08X (%u writes)\n",
+						bits, value, levels[i], gpioLevel, expected, gpioWrites);
+				}
+				fails++;
+			}
+		}
+	}
+	return fails;
+}
+
+int main(int argv, char** argc){
+	unsigned int fails;
+	(void)argc;
+
+	if(argv > 1){
+		fprintf(stderr, "Usage: bustables\n");
+		return EXIT_FAILURE;
+	}
+
+	tftglInitBusTables();
+	fails = busCheck(16) + busCheck(8);
+	if(busMask != busSetLo[0xFF] + busSetHi[0xFF] || busMaskLo != busSetLo[0xFF]){
+		fprintf(stderr, "Data pin masks overlap\n");
+		fails++;
+	}
+
+	printf("bus tables: %u values of 16 and 256 of 8 bits, %u failed\n", 1 << 16, fails);
+	return fails == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
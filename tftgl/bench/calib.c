@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// Add TFTGL library
+#include <tftgl.h>
+
+// Checks tftglSolveTouchCalibration on synthetic panels, no display or
+// touch screen needed. Each panel maps the screen to raw coordinates
+// with a rotation, a skew, a mirrored axis or all of them, the touches
+// of the calibration points get up to CALIB_NOISE raw units of noise.
+// Over the area the targets span the solved matrix must be within
+// CALIB_MAX_ERROR pixels of the true position: everywhere for 3 points
+// without noise, as RMS for 5 noisy points in every trial (the noise of
+// one touch alone is almost a pixel, the fit averages it out, the
+// largest error is only reported). Points on a line must be refused
+// with TFTGL_BAD_CALIB.
+//
+// Usage: calib [--trials N]
+
+#define CALIB_WIDTH 800
+#define CALIB_HEIGHT 480
+#define CALIB_NOISE 4 // Raw units, either way
+#define CALIB_MAX_ERROR 1.0 // Pixels
+#define CALIB_GRID 16 // Pixels between the checked positions
+
+typedef struct {
+	const char* name;
+	double angle; // Degrees
+	double skew; // Raw X per raw Y
+	int mirrorX, mirrorY;
+} CalibPanel;
+
+static const CalibPanel panels[] = {
+	{"straight", 0.0, 0.0, 0, 0},
+	{"rotated", 2.5, 0.0, 0, 0},
+	{"skewed", 0.0, 0.04, 0, 0},
+	{"mirrored_x", 0.0, 0.0, 1, 0},
+	{"mirrored_y", 0.0, 0.0, 0, 1},
+	{"all", -3.0, 0.03, 1, 0},
+	{"portrait", 90.0, 0.0, 0, 1},
+};
+
+// The calibration targets of examples/calibrate.c, in fractions of the
+// screen: the corners inset by 10% and the centre
+static const double targets[5][2] = {
+	{0.1, 0.1}, {0.9, 0.1}, {0.9, 0.9}, {0.1, 0.9}, {0.5, 0.5},
+};
+
+static unsigned int seed = 12345;
+
+// Deterministic noise from -CALIB_NOISE to CALIB_NOISE
+static int calibNoise(){
+	seed = seed * 1103515245 + 12345;
+	return (int)((seed >> 16) % (2 * CALIB_NOISE + 1)) - CALIB_NOISE;
+}
+
+// Raw coordinates of a screen position, the panel covers 200 to 3900
+// of both raw axes
+static void calibRaw(const CalibPanel* p, double x, double y, double* rawX, double* rawY){
+	double a = p->angle * 3.14159265358979 / 180.0;
+	double u = (x - CALIB_WIDTH / 2.0) / CALIB_WIDTH;
+	double v = (y - CALIB_HEIGHT / 2.0) / CALIB_HEIGHT;
+	double ru, rv;
+
+	// Square panel axes, then rotated, skewed and mirrored
+	if(p->angle == 90.0){
+		ru = -v;
+		rv = u;
+	} else {
+		ru = u * cos(a) - v * sin(a);
+		rv = u * sin(a) + v * cos(a);
+	}
+	ru += p->skew * rv;
+	if(p->mirrorX)ru = -ru;
+	if(p->mirrorY)rv = -rv;
+	*rawX = 2050.0 + ru * 3700.0;
+	*rawY = 2050.0 + rv * 3700.0;
+}
+
+// Distance from where the matrix maps the raw coordinates of a pixel to
+// the pixel, RMS and largest over the area of the targets
+static void calibError(const CalibPanel* p, const TftglTouchCalibration* m, double* rms, double* worst){
+	double sum = 0, rawX, rawY, x, y, d;
+	unsigned int u, v, n = 0;
+
+	for(v = CALIB_HEIGHT / 10; v <= CALIB_HEIGHT * 9 / 10; v += CALIB_GRID){
+		for(u = CALIB_WIDTH / 10; u <= CALIB_WIDTH * 9 / 10; u += CALIB_GRID){
+			calibRaw(p, u, v, &rawX, &rawY);
+			rawX = floor(rawX + 0.5);
+			rawY = floor(rawY + 0.5);
+			x = (m->a * rawX + m->b * rawY + m->c) / 65536.0;
+			y = (m->d * rawX + m->e * rawY + m->f) / 65536.0;
+			d = (x - u) * (x - u) + (y - v) * (y - v);
+			sum += d;
+			n++;
+			if(d > *worst)*worst = d;
+		}
+	}
+	*rms = sqrt(sum / n);
+	*worst = sqrt(*worst);
+}
+
+// Solves the calibration of count targets, returns TFTGL_ERROR if it was
+// refused
+static unsigned int calibSolve(const CalibPanel* p, unsigned int count, int noise, double* rms,
+	double* worst){
+	TftglCalibrationPoint points[5];
+	TftglTouchCalibration m;
+	double rawX, rawY;
+	unsigned int i;
+
+	for(i = 0; i < count; i++){
+		points[i].x = (unsigned int)(targets[i][0] * CALIB_WIDTH);
+		points[i].y = (unsigned int)(targets[i][1] * CALIB_HEIGHT);
+		calibRaw(p, points[i].x, points[i].y, &rawX, &rawY);
+		points[i].rawX = (unsigned int)(rawX + 0.5) + (noise ? calibNoise() : 0);
+		points[i].rawY = (unsigned int)(rawY + 0.5) + (noise ? calibNoise() : 0);
+	}
+	if(tftglSolveTouchCalibration(points, count, &m) != TFTGL_OK)return TFTGL_ERROR;
+	*worst = 0;
+	calibError(p, &m, rms, worst);
+	return TFTGL_OK;
+}
+
+// Points on a line leave one direction unknown, returns the number of
+// lines that were not refused
+static unsigned int calibCollinear(){
+	TftglCalibrationPoint points[5];
+	TftglTouchCalibration m;
+	unsigned int i, fails = 0;
+
+	// Along the diagonal, with noise below the refusal threshold
+	for(i = 0; i < 5; i++){
+		points[i].x = 100 + i * 150;
+		points[i].y = 50 + i * 90;
+		points[i].rawX = 300 + i * 800 + (i % 2);
+		points[i].rawY = 400 + i * 700;
+	}
+	if(tftglSolveTouchCalibration(points, 5, &m) != TFTGL_ERROR || tftglGetError() != TFTGL_BAD_CALIB){
+		fprintf(stderr, "5 points on a line were not refused\n");
+		fails++;
+	}
+
+	// The same spot touched three times
+	for(i = 0; i < 3; i++){
+		points[i].x = 100 + i * 300;
+		points[i].y = 100 + (i % 2) * 200;
+		points[i].rawX = 2000;
+		points[i].rawY = 2000;
+	}
+	if(tftglSolveTouchCalibration(points, 3, &m) != TFTGL_ERROR || tftglGetError() != TFTGL_BAD_CALIB){
+		fprintf(stderr, "3 touches of the same spot were not refused\n");
+		fails++;
+	}
+
+	// Too few points
+	if(tftglSolveTouchCalibration(points, 2, &m) != TFTGL_ERROR || tftglGetError() != TFTGL_BAD_CALIB){
+		fprintf(stderr, "2 points were not refused\n");
+		fails++;
+	}
+	return fails;
+}
+
+//==============================================================================
+int main(int argv, char** argc){
+	unsigned int trials = 1000, fails = 0, p, t;
+	int i;
+
+	for(i = 1; i < argv; i++){
+		if(strcmp(argc[i], "--trials") == 0 && i + 1 < argv){
+			trials = atoi(argc[++i]);
+		} else {
+			fprintf(stderr, "Usage: %s [--trials N]\n", argc[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("panel,points,noise,trials,rms_px,max_px\n");
+	for(p = 0; p < sizeof(panels) / sizeof(panels[0]); p++){
+		double rms, worst, worstRms = 0, worstMax = 0;
+		unsigned int refused = 0;
+
+		if(calibSolve(&panels[p], 3, 0, &rms, &worst) != TFTGL_OK || worst > CALIB_MAX_ERROR){
+			fprintf(stderr, "%s: 3 points are off by %.3f px\n", panels[p].name, worst);
+			fails++;
+		}
+		printf("%s,3,0,1,%.3f,%.3f\n", panels[p].name, rms, worst);
+
+		for(t = 0; t < trials; t++){
+			if(calibSolve(&panels[p], 5, 1, &rms, &worst) != TFTGL_OK){
+				refused++;
+				continue;
+			}
+			if(rms > worstRms)worstRms = rms;
+			if(worst > worstMax)worstMax = worst;
+		}
+		printf("%s,5,%d,%u,%.3f,%.3f\n", panels[p].name, CALIB_NOISE, trials, worstRms, worstMax);
+
+		if(refused > 0 || worstRms > CALIB_MAX_ERROR){
+			fprintf(stderr, "%s: 5 noisy points are off by %.3f px RMS, %u refused\n",
+				panels[p].name, worstRms, refused);
+			fails++;
+		}
+	}
+	fails += calibCollinear();
+
+	printf("calibration: %u failed\n", fails);
+	return fails == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
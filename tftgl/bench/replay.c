@@ -0,0 +1,466 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+// Add TFTGL library
+#include <tftgl.h>
+
+// The touch filter of the library, the very same code
+#include "../src/tftgl_filter.h"
+
+// Replays touch traces through the filter pipeline with every combination
+// of samples per axis, combining and the 1-euro filter, and reports the
+// jitter and the lag of each. Without a trace it replays a synthetic one
+// (a held finger, a swipe, a circle and a slow drag with noisy and spiking
+// conversions) of which the true position is known.
+//
+// A trace is a text file, one reading per line:
+//   micros truthX truthY z1 z2 x0 .. x15 y0 .. y15
+// The truth is -1 if unknown (recorded traces), it is then the median of
+// all samples smoothed over the neighbouring readings. Lines starting with
+// # are comments. The pen is up if z1 is not above the sensitivity.
+//
+// Usage: replay [--json] [--min-cutoff HZ] [--beta B] [--write FILE]
+//               [--record FILE [--seconds N]] [trace ...]
+
+#define REPLAY_SAMPLES 16
+#define REPLAY_MAX_READINGS 100000
+#define REPLAY_PRESSURE 100 // The default of tftglSetTouchSensitivity
+#define REPLAY_INTERVAL 10000 // us, the default rate of the sampler
+#define REPLAY_STILL 20.0 // Raw units per second, slower is a held finger
+#define REPLAY_MOVING 200.0 // Raw units per second, faster is a swipe
+#define REPLAY_MAX_LAG 100 // ms
+
+typedef struct {
+	unsigned long micros;
+	double truthX, truthY;
+	unsigned int z1, z2;
+	unsigned int x[REPLAY_SAMPLES];
+	unsigned int y[REPLAY_SAMPLES];
+} Reading;
+
+typedef struct {
+	char trace[64];
+	unsigned int samples;
+	unsigned int combine;
+	unsigned int euro;
+	unsigned int conversions; // Per reading
+	double skipped; // Percent of the readings with the pen down
+	double jitter; // RMS of the steps of a held finger, raw units
+	double error; // RMS distance to the true position, raw units
+	double lag; // ms, -1 without movement
+} ReplayResult;
+
+static Reading readings[REPLAY_MAX_READINGS];
+static unsigned int readingCount = 0;
+static double outX[REPLAY_MAX_READINGS];
+static double outY[REPLAY_MAX_READINGS];
+static unsigned char outValid[REPLAY_MAX_READINGS];
+static ReplayResult results[256];
+static unsigned int resultCount = 0;
+static float minCutoff = 0;
+static float beta = 0;
+
+static const char* combineNames[] = {"mean", "median", "trimmed"};
+
+// Deterministic noise, the same trace on every machine
+static unsigned int seed = 12345;
+
+static double replayRandom(){
+	seed = seed * 1103515245 + 12345;
+	return ((seed >> 8) & 0xFFFF) / 65536.0;
+}
+
+static double replayGauss(){
+	double u = replayRandom() + 1e-9, v = replayRandom();
+	return sqrt(-2.0 * log(u)) * cos(6.2831853 * v);
+}
+
+static unsigned int replayClamp(double v){
+	if(v < 0)return 0;
+	if(v > 4095)return 4095;
+	return (unsigned int)(v + 0.5);
+}
+
+static void replayAdd(unsigned long micros, double x, double y, unsigned int down, double firmness){
+	Reading* r = &readings[readingCount++];
+	unsigned int i;
+
+	r->micros = micros;
+	r->truthX = down ? x : -1;
+	r->truthY = down ? y : -1;
+	// The touch resistance is x * (z2 / z1 - 1) in 1/4096 of the X plate,
+	// from about 300 for a firm touch to about 1000 for a light one
+	r->z1 = down ? replayClamp(400 + replayGauss() * 10) : 0;
+	r->z2 = down ? replayClamp(r->z1 * (1 + (1300 - 1000 * firmness) / (x > 1 ? x : 1)) +
+		replayGauss() * 10) : 4095;
+	for(i = 0; i < REPLAY_SAMPLES; i++){
+		// Light touches have a higher contact resistance and more noise
+		double noise = 8 + 40 * (1 - firmness);
+		double sx = x + replayGauss() * noise, sy = y + replayGauss() * noise;
+		// Spikes of a resistive panel, a few percent of the conversions
+		if(replayRandom() < 0.03)sx += (replayRandom() < 0.5 ? -1 : 1) * (200 + replayRandom() * 400);
+		if(replayRandom() < 0.03)sy += (replayRandom() < 0.5 ? -1 : 1) * (200 + replayRandom() * 400);
+		r->x[i] = down ? replayClamp(sx) : 0;
+		r->y[i] = down ? replayClamp(sy) : 0;
+	}
+}
+
+// Pen up, then a stroke of the given shape and duration
+static void replayStroke(unsigned long* t, unsigned int shape, double seconds){
+	unsigned int i, n = (unsigned int)(seconds * 1000000 / REPLAY_INTERVAL);
+
+	for(i = 0; i < 20; i++, *t += REPLAY_INTERVAL)replayAdd(*t, 0, 0, 0, 0);
+	for(i = 0; i < n; i++, *t += REPLAY_INTERVAL){
+		double p = (double)i / (n - 1), s = p * p * (3 - 2 * p), x, y;
+		// Lighter at the start and the end of the stroke
+		double firmness = (i < 4 || n - i <= 4) ? 0.3 : 1.0;
+		switch(shape){
+			case 0: x = 1500; y = 2000; break; // Held finger
+			case 1: x = 800 + 2500 * s; y = 1800; break; // Swipe
+			case 2: x = 2000 + 700 * cos(6.2831853 * p); y = 2000 + 700 * sin(6.2831853 * p); break;
+			default: x = 1000 + 1200 * p; y = 2500 - 300 * p; break; // Slow drag
+		}
+		if(shape == 1){
+			// Held before and after the swipe
+			double q = p * 3 - 1;
+			q = q < 0 ? 0 : (q > 1 ? 1 : q);
+			x = 800 + 2500 * q * q * (3 - 2 * q);
+		}
+		replayAdd(*t, x, y, 1, firmness);
+	}
+}
+
+static void replaySynthetic(){
+	unsigned long t = 0;
+	unsigned int i;
+	readingCount = 0;
+	replayStroke(&t, 0, 2.0);
+	replayStroke(&t, 1, 1.2);
+	replayStroke(&t, 2, 1.5);
+	replayStroke(&t, 3, 2.0);
+	for(i = 0; i < 20; i++, t += REPLAY_INTERVAL)replayAdd(t, 0, 0, 0, 0);
+}
+
+static unsigned int replayLoad(const char* filename){
+	char line[1024];
+	FILE* file = fopen(filename, "r");
+	if(file == NULL){
+		fprintf(stderr, "Failed to open %s!\n", filename);
+		return 0;
+	}
+
+	readingCount = 0;
+	while(fgets(line, sizeof(line), file) != NULL && readingCount < REPLAY_MAX_READINGS){
+		Reading* r = &readings[readingCount];
+		char* p = line;
+		int used;
+		unsigned int i;
+
+		if(line[0] == '#' || line[0] == '\n')continue;
+		if(sscanf(p, "%lu %lf %lf %u %u%n", &r->micros, &r->truthX, &r->truthY, &r->z1, &r->z2, &used) != 5){
+			break;
+		}
+		p += used;
+		for(i = 0; i < REPLAY_SAMPLES * 2; i++){
+			unsigned int* v = i < REPLAY_SAMPLES ? &r->x[i] : &r->y[i - REPLAY_SAMPLES];
+			if(sscanf(p, "%u%n", v, &used) != 1)break;
+			p += used;
+		}
+		if(i < REPLAY_SAMPLES * 2){
+			fprintf(stderr, "Bad line %u in %s!\n", readingCount + 1, filename);
+			fclose(file);
+			return 0;
+		}
+		readingCount++;
+	}
+	fclose(file);
+	return readingCount > 0;
+}
+
+static void replayWrite(FILE* file){
+	unsigned int i, j;
+	fprintf(file, "# tftgl touch trace: micros truthX truthY z1 z2 x0 .. x15 y0 .. y15\n");
+	for(i = 0; i < readingCount; i++){
+		const Reading* r = &readings[i];
+		fprintf(file, "%lu %.1f %.1f %u %u", r->micros, r->truthX, r->truthY, r->z1, r->z2);
+		for(j = 0; j < REPLAY_SAMPLES; j++)fprintf(file, " %u", r->x[j]);
+		for(j = 0; j < REPLAY_SAMPLES; j++)fprintf(file, " %u", r->y[j]);
+		fprintf(file, "\n");
+	}
+}
+
+static unsigned int replayDown(const Reading* r){
+	return r->z1 > REPLAY_PRESSURE;
+}
+
+// Recorded traces do not know the true position, use the median of all
+// samples averaged over the two readings before and after
+static void replayEstimateTruth(){
+	static double medX[REPLAY_MAX_READINGS], medY[REPLAY_MAX_READINGS];
+	unsigned int i, spread, samples[REPLAY_SAMPLES];
+	int j;
+
+	for(i = 0; i < readingCount; i++){
+		memcpy(samples, readings[i].x, sizeof(samples));
+		medX[i] = tftglTouchCombine(samples, REPLAY_SAMPLES, TFTGL_TOUCH_MEDIAN, &spread);
+		memcpy(samples, readings[i].y, sizeof(samples));
+		medY[i] = tftglTouchCombine(samples, REPLAY_SAMPLES, TFTGL_TOUCH_MEDIAN, &spread);
+	}
+	for(i = 0; i < readingCount; i++){
+		double sx = 0, sy = 0;
+		unsigned int n = 0;
+		if(readings[i].truthX >= 0 || !replayDown(&readings[i]))continue;
+		for(j = (int)i - 2; j <= (int)i + 2; j++){
+			if(j < 0 || j >= (int)readingCount || !replayDown(&readings[j]))continue;
+			sx += medX[j];
+			sy += medY[j];
+			n++;
+		}
+		readings[i].truthX = sx / n;
+		readings[i].truthY = sy / n;
+	}
+}
+
+// Speed of the true position (raw units per second)
+static double replaySpeed(unsigned int i){
+	double dt;
+	if(i == 0 || !replayDown(&readings[i - 1]))return 0;
+	dt = (readings[i].micros - readings[i - 1].micros) / 1000000.0;
+	if(dt <= 0)return 0;
+	return hypot(readings[i].truthX - readings[i - 1].truthX, readings[i].truthY - readings[i - 1].truthY) / dt;
+}
+
+// True position at the given time, linear between the readings of the
+// stroke of reading i, zero if the time is before the stroke
+static unsigned int replayTruthAt(unsigned int i, double micros, double* x, double* y){
+	while(i > 0 && readings[i].micros > micros){
+		if(!replayDown(&readings[i - 1]))return 0;
+		i--;
+	}
+	if(readings[i].micros > micros)return 0;
+	if(i + 1 < readingCount && replayDown(&readings[i + 1]) && readings[i + 1].micros > readings[i].micros){
+		double f = (micros - readings[i].micros) / (readings[i + 1].micros - readings[i].micros);
+		*x = readings[i].truthX + (readings[i + 1].truthX - readings[i].truthX) * f;
+		*y = readings[i].truthY + (readings[i + 1].truthY - readings[i].truthY) * f;
+	} else {
+		*x = readings[i].truthX;
+		*y = readings[i].truthY;
+	}
+	return 1;
+}
+
+static void replayRun(const char* trace, unsigned int samples, unsigned int combine, unsigned int euro){
+	TftglTouchFilter filter = TOUCH_FILTER_DEFAULT;
+	TftglTouchEuro state;
+	ReplayResult* res = &results[resultCount++];
+	unsigned int i, down = 0, skipped = 0, still = 0, moving = 0, count = 0;
+	unsigned int values[TOUCH_MAX_SAMPLES * 2 + 2];
+	double jitter = 0, error = 0, bestLag = -1, bestError = 0;
+	int lag, last = -1;
+
+	filter.samples = samples;
+	filter.combine = combine;
+	if(minCutoff > 0)filter.minCutoff = minCutoff;
+	if(beta > 0)filter.beta = beta;
+	if(!euro)filter.minCutoff = 0;
+	tftglTouchEuroReset(&state);
+
+	for(i = 0; i < readingCount; i++){
+		const Reading* r = &readings[i];
+		unsigned int x, y;
+
+		outValid[i] = 0;
+		if(!replayDown(r)){
+			tftglTouchEuroReset(&state);
+			last = -1;
+			continue;
+		}
+		down++;
+		memcpy(&values[0], r->x, samples * sizeof(unsigned int));
+		memcpy(&values[samples], r->y, samples * sizeof(unsigned int));
+		values[samples * 2] = r->z1;
+		values[samples * 2 + 1] = r->z2;
+		if(tftglTouchFilterReading(&filter, &state, values, &x, &y, r->micros) != TOUCH_PRESSED){
+			skipped++;
+			continue;
+		}
+		outValid[i] = 1;
+		outX[i] = x;
+		outY[i] = y;
+		error += (x - r->truthX) * (x - r->truthX) + (y - r->truthY) * (y - r->truthY);
+		count++;
+		if(last >= 0 && replaySpeed(i) < REPLAY_STILL && replaySpeed(last) < REPLAY_STILL){
+			jitter += (x - outX[last]) * (x - outX[last]) + (y - outY[last]) * (y - outY[last]);
+			still++;
+		}
+		last = i;
+	}
+
+	// The lag is the delay of the true position that fits the output best
+	// while moving
+	for(lag = 0; lag <= REPLAY_MAX_LAG; lag++){
+		double sum = 0, tx, ty;
+		moving = 0;
+		for(i = 0; i < readingCount; i++){
+			if(!outValid[i] || replaySpeed(i) < REPLAY_MOVING)continue;
+			if(!replayTruthAt(i, readings[i].micros - lag * 1000.0, &tx, &ty))continue;
+			sum += (outX[i] - tx) * (outX[i] - tx) + (outY[i] - ty) * (outY[i] - ty);
+			moving++;
+		}
+		if(moving > 0 && (bestLag < 0 || sum < bestError)){
+			bestError = sum;
+			bestLag = lag;
+		}
+	}
+
+	snprintf(res->trace, sizeof(res->trace), "%s", trace);
+	res->samples = samples;
+	res->combine = combine;
+	res->euro = euro;
+	res->conversions = samples * 2 + 2;
+	res->skipped = down > 0 ? 100.0 * skipped / down : 0;
+	res->jitter = still > 0 ? sqrt(jitter / still) : 0;
+	res->error = count > 0 ? sqrt(error / count) : 0;
+	res->lag = bestLag;
+}
+
+static void replayAll(const char* trace){
+	static const unsigned int samples[] = {3, 5, 8};
+	unsigned int s, c, e;
+	for(s = 0; s < 3; s++){
+		for(c = TFTGL_TOUCH_MEAN; c <= TFTGL_TOUCH_TRIMMED; c++){
+			for(e = 0; e < 2; e++)replayRun(trace, samples[s], c, e);
+		}
+	}
+}
+
+// Records a trace on the device, the readings at the default rate of the
+// sampler thread
+static int replayRecord(const char* filename, unsigned int seconds){
+	unsigned int samples[REPLAY_SAMPLES * 2 + 2];
+	struct timespec ts;
+	unsigned long start, now;
+	FILE* file;
+
+	if(tftglInit(TFTGL_LANDSCAPE) != TFTGL_OK){
+		fprintf(stderr, "Failed to initialize TFTGL library! Error: %s\n", tftglGetErrorStr());
+		return EXIT_FAILURE;
+	}
+	file = fopen(filename, "w");
+	if(file == NULL){
+		fprintf(stderr, "Failed to open %s!\n", filename);
+		tftglTerminate();
+		return EXIT_FAILURE;
+	}
+	printf("Recording %u seconds, touch and drag on the screen\n", seconds);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	start = ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+	readingCount = 0;
+	do {
+		Reading* r = &readings[readingCount++];
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		now = ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+		tftglGetTouchSamples(samples, REPLAY_SAMPLES);
+		r->micros = now - start;
+		r->truthX = r->truthY = -1;
+		memcpy(r->x, &samples[0], sizeof(r->x));
+		memcpy(r->y, &samples[REPLAY_SAMPLES], sizeof(r->y));
+		r->z1 = samples[REPLAY_SAMPLES * 2];
+		r->z2 = samples[REPLAY_SAMPLES * 2 + 1];
+		usleep(REPLAY_INTERVAL);
+	} while(now - start < seconds * 1000000UL && readingCount < REPLAY_MAX_READINGS);
+
+	replayWrite(file);
+	fclose(file);
+	tftglTerminate();
+	printf("Wrote %u readings to %s\n", readingCount, filename);
+	return EXIT_SUCCESS;
+}
+
+static void printCsv(){
+	unsigned int i;
+	printf("trace,samples,combine,euro,conversions,skipped_pct,jitter_raw,error_raw,lag_ms\n");
+	for(i = 0; i < resultCount; i++){
+		ReplayResult* r = &results[i];
+		printf("%s,%u,%s,%s,%u,%.1f,%.2f,%.2f,%.0f\n", r->trace, r->samples, combineNames[r->combine],
+			r->euro ? "on" : "off", r->conversions, r->skipped, r->jitter, r->error, r->lag);
+	}
+}
+
+static void printJson(){
+	unsigned int i;
+	printf("[\n");
+	for(i = 0; i < resultCount; i++){
+		ReplayResult* r = &results[i];
+		printf("  {\"trace\": \"%s\", \"samples\": %u, \"combine\": \"%s\", \"euro\": %s, "
+			"\"conversions\": %u, \"skipped_pct\": %.1f, \"jitter_raw\": %.2f, \"error_raw\": %.2f, "
+			"\"lag_ms\": %.0f}%s\n", r->trace, r->samples, combineNames[r->combine],
+			r->euro ? "true" : "false", r->conversions, r->skipped, r->jitter, r->error, r->lag,
+			i + 1 < resultCount ? "," : "");
+	}
+	printf("]\n");
+}
+
+int main(int argv, char** argc){
+	const char* writeFile = NULL;
+	const char* recordFile = NULL;
+	unsigned int json = 0, seconds = 10, traces = 0;
+	int i;
+
+	for(i = 1; i < argv; i++){
+		if(strcmp(argc[i], "--json") == 0){
+			json = 1;
+		} else if(strcmp(argc[i], "--min-cutoff") == 0 && i + 1 < argv){
+			minCutoff = atof(argc[++i]);
+		} else if(strcmp(argc[i], "--beta") == 0 && i + 1 < argv){
+			beta = atof(argc[++i]);
+		} else if(strcmp(argc[i], "--write") == 0 && i + 1 < argv){
+			writeFile = argc[++i];
+		} else if(strcmp(argc[i], "--record") == 0 && i + 1 < argv){
+			recordFile = argc[++i];
+		} else if(strcmp(argc[i], "--seconds") == 0 && i + 1 < argv){
+			seconds = atoi(argc[++i]);
+		} else if(argc[i][0] == '-'){
+			fprintf(stderr, "Usage: %s [--json] [--min-cutoff HZ] [--beta B] [--write FILE] "
+				"[--record FILE [--seconds N]] [trace ...]\n", argc[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(recordFile != NULL)return replayRecord(recordFile, seconds);
+
+	for(i = 1; i < argv; i++){
+		if(argc[i][0] == '-'){
+			// Skip the value of the options that take one
+			if(strcmp(argc[i], "--json") != 0)i++;
+			continue;
+		}
+		if(!replayLoad(argc[i]))return EXIT_FAILURE;
+		replayEstimateTruth();
+		replayAll(argc[i]);
+		traces++;
+	}
+
+	if(traces == 0){
+		replaySynthetic();
+		if(writeFile != NULL){
+			FILE* file = fopen(writeFile, "w");
+			if(file == NULL){
+				fprintf(stderr, "Failed to open %s!\n", writeFile);
+				return EXIT_FAILURE;
+			}
+			replayWrite(file);
+			fclose(file);
+		}
+		replayAll("synthetic");
+	}
+
+	if(json)printJson();
+	else printCsv();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "tftgl_client.h"
+#include "tftgl_shm.h"
+
+struct TftglClientStruct {
+	int sock;
+	int event;
+	TftglShmSurface* shm;
+	size_t size;
+	unsigned short* pixels;
+	unsigned int width;
+	unsigned int height;
+	unsigned int stride;
+	unsigned int screenWidth;
+	unsigned int screenHeight;
+};
+
+static unsigned int errorCode = TFTGL_OK;
+
+// Sends the request and receives the reply with the memfd and the eventfd
+static unsigned int tftglClientHandshake(TftglClient* client, const TftglShmRequest* req, int* memfd){
+	TftglShmReply reply;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr* cmsg;
+	union {
+		char buf[CMSG_SPACE(2 * sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	ssize_t n;
+
+	if(send(client->sock, req, sizeof(TftglShmRequest), MSG_NOSIGNAL) != sizeof(TftglShmRequest)){
+		errorCode = TFTGL_CLIENT_NO_DAEMON;
+		return TFTGL_ERROR;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &reply;
+	iov.iov_len = sizeof(reply);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	n = recvmsg(client->sock, &msg, MSG_CMSG_CLOEXEC);
+	if(n != sizeof(reply)){
+		errorCode = TFTGL_CLIENT_NO_DAEMON;
+		return TFTGL_ERROR;
+	}
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if(cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+		cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int))){
+		int fds[2];
+		memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+		*memfd = fds[0];
+		client->event = fds[1];
+	}
+
+	if(reply.status != TFTGL_OK){
+		errorCode = reply.status;
+		return TFTGL_ERROR;
+	}
+	if(*memfd < 0 || client->event < 0){
+		errorCode = TFTGL_CLIENT_NO_DAEMON;
+		return TFTGL_ERROR;
+	}
+	client->size = reply.size;
+	client->screenWidth = reply.screenWidth;
+	client->screenHeight = reply.screenHeight;
+	return TFTGL_OK;
+}
+
+TftglClient* tftglClientConnect(const char* socketPath, unsigned int x, unsigned int y,
+	unsigned int w, unsigned int h){
+	struct sockaddr_un addr;
+	TftglShmRequest req;
+	TftglClient* client;
+	int memfd = -1;
+	void* map;
+
+	if(socketPath == NULL)socketPath = TFTGL_SHM_DEFAULT_SOCKET;
+	if(strlen(socketPath) >= sizeof(addr.sun_path)){
+		errorCode = TFTGL_CLIENT_NO_DAEMON;
+		return NULL;
+	}
+
+	client = calloc(1, sizeof(TftglClient));
+	if(client == NULL){
+		errorCode = TFTGL_CLIENT_OUT_OF_MEM;
+		return NULL;
+	}
+	client->event = -1;
+
+	client->sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socketPath);
+	if(client->sock < 0 || connect(client->sock, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+		errorCode = TFTGL_CLIENT_NO_DAEMON;
+		goto fail;
+	}
+
+	req.version = TFTGL_SHM_VERSION;
+	req.x = x;
+	req.y = y;
+	req.w = w;
+	req.h = h;
+	if(tftglClientHandshake(client, &req, &memfd) != TFTGL_OK)goto fail;
+
+	map = mmap(NULL, client->size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+	close(memfd);
+	memfd = -1;
+	if(map == MAP_FAILED){
+		errorCode = TFTGL_CLIENT_OUT_OF_MEM;
+		goto fail;
+	}
+	client->shm = map;
+
+	if(client->shm->magic != TFTGL_SHM_MAGIC || client->shm->version != TFTGL_SHM_VERSION){
+		errorCode = TFTGL_CLIENT_BAD_VERSION;
+		goto fail;
+	}
+	client->width = client->shm->width;
+	client->height = client->shm->height;
+	client->stride = client->shm->stride;
+	client->pixels = (unsigned short*)((unsigned char*)map + client->shm->pixelsOffset);
+	return client;
+
+fail:
+	if(memfd >= 0)close(memfd);
+	tftglClientDisconnect(client);
+	return NULL;
+}
+
+void tftglClientDisconnect(TftglClient* client){
+	if(client == NULL)return;
+	// The daemon drops the surface when the socket is closed
+	if(client->shm != NULL)munmap(client->shm, client->size);
+	if(client->event >= 0)close(client->event);
+	if(client->sock >= 0)close(client->sock);
+	free(client);
+}
+
+unsigned int tftglClientGetWidth(const TftglClient* client){
+	return client->width;
+}
+
+unsigned int tftglClientGetHeight(const TftglClient* client){
+	return client->height;
+}
+
+unsigned int tftglClientGetScreenWidth(const TftglClient* client){
+	return client->screenWidth;
+}
+
+unsigned int tftglClientGetScreenHeight(const TftglClient* client){
+	return client->screenHeight;
+}
+
+unsigned int tftglClientGetError(){
+	unsigned int cpy = errorCode;
+	errorCode = TFTGL_OK;
+	return cpy;
+}
+
+const char* tftglClientGetErrorStr(){
+	unsigned int cpy = errorCode;
+	errorCode = TFTGL_OK;
+
+	switch(cpy){
+		case TFTGL_ERROR: return "TFTGL_ERROR (Generic error!)";
+		case TFTGL_OK: return "TFTGL_OK";
+		case TFTGL_CLIENT_NO_DAEMON: return "TFTGL_CLIENT_NO_DAEMON (Could not connect to tftgld! Is it running?)";
+		case TFTGL_CLIENT_BAD_AREA: return "TFTGL_CLIENT_BAD_AREA (Surface does not fit the screen!)";
+		case TFTGL_CLIENT_BAD_VERSION: return "TFTGL_CLIENT_BAD_VERSION (tftgld has a different version!)";
+		case TFTGL_CLIENT_OUT_OF_MEM: return "TFTGL_CLIENT_OUT_OF_MEM (System is out of memory!)";
+		case TFTGL_CLIENT_TOO_MANY: return "TFTGL_CLIENT_TOO_MANY (tftgld has no room for more surfaces!)";
+		default: return "TFTGL_UNKNOWN_ERROR";
+	}
+	return "TFTGL_UNKNOWN_ERROR";
+}
+
+// Clips the area to the surface, returns zero if nothing is left
+static unsigned int tftglClientClip(const TftglClient* client, unsigned int x, unsigned int y,
+	unsigned int* w, unsigned int* h){
+	if(x >= client->width || y >= client->height)return 0;
+	if(*w == 0 || *h == 0)return 0;
+	if(*w > client->width - x)*w = client->width - x;
+	if(*h > client->height - y)*h = client->height - y;
+	return 1;
+}
+
+void tftglClientAddDamage(TftglClient* client, unsigned int x, unsigned int y,
+	unsigned int w, unsigned int h){
+	TftglShmSurface* shm = client->shm;
+	unsigned int head, tail;
+	uint64_t one = 1;
+
+	if(!tftglClientClip(client, x, y, &w, &h))return;
+
+	// Single producer, only this process moves the head
+	head = atomic_load_explicit(&shm->head, memory_order_relaxed);
+	tail = atomic_load_explicit(&shm->tail, memory_order_acquire);
+	if(head - tail >= TFTGL_SHM_RING){
+		// The daemon is behind, it will send the whole surface
+		atomic_store_explicit(&shm->overflow, 1, memory_order_release);
+	} else {
+		TftglShmRect* r = &shm->rects[head % TFTGL_SHM_RING];
+		r->x = x;
+		r->y = y;
+		r->w = w;
+		r->h = h;
+		atomic_store_explicit(&shm->head, head + 1, memory_order_release);
+	}
+
+	// Wake the daemon up, it gathers the damage of a frame before sending
+	if(write(client->event, &one, sizeof(one)) < 0){
+		// Full counter, the daemon has a wakeup pending anyway
+	}
+}
+
+unsigned short* tftglClientGetPixels(TftglClient* client, unsigned int* stride){
+	if(stride != NULL)*stride = client->stride;
+	return client->pixels;
+}
+
+void tftglClientFillColor(TftglClient* client, unsigned int x, unsigned int y,
+	unsigned int w, unsigned int h, const unsigned char* color){
+	unsigned int i, j;
+
+	if(!tftglClientClip(client, x, y, &w, &h))return;
+
+	// Convert RGB-888 to RGB-565
+	unsigned short rgb = ((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | color[2] >> 3;
+
+	for(j = 0; j < h; j++){
+		unsigned short* dst = &client->pixels[(y + j) * client->stride + x];
+		for(i = 0; i < w; i++)dst[i] = rgb;
+	}
+	tftglClientAddDamage(client, x, y, w, h);
+}
+
+void tftglClientFillPixels(TftglClient* client, unsigned int x, unsigned int y,
+	unsigned int w, unsigned int h, const unsigned char* pixels){
+	unsigned int i, j, fullW = w, fullH = h;
+
+	if(!tftglClientClip(client, x, y, &w, &h))return;
+
+	// Rows are bottom to top, rows below the surface come first in the buffer
+	for(j = 0; j < h; j++){
+		const unsigned char* src = &pixels[(fullH - 1 - j) * fullW * 3];
+		unsigned short* dst = &client->pixels[(y + j) * client->stride + x];
+		for(i = 0; i < w; i++){
+			dst[i] = ((src[0] >> 3) << 11) | ((src[1] >> 2) << 5) | src[2] >> 3;
+			src += 3;
+		}
+	}
+	tftglClientAddDamage(client, x, y, w, h);
+}
+
+void tftglClientFillPixels565(TftglClient* client, unsigned int x, unsigned int y,
+	unsigned int w, unsigned int h, const unsigned short* pixels){
+	unsigned int j, fullW = w, fullH = h;
+
+	if(!tftglClientClip(client, x, y, &w, &h))return;
+
+	// Rows are bottom to top, the same as tftglClientFillPixels
+	for(j = 0; j < h; j++){
+		memcpy(&client->pixels[(y + j) * client->stride + x], &pixels[(fullH - 1 - j) * fullW],
+			w * sizeof(unsigned short));
+	}
+	tftglClientAddDamage(client, x, y, w, h);
+}
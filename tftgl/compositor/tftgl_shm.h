@@ -0,0 +1,73 @@
+#ifndef _TFTGL_SHM_H_
+#define _TFTGL_SHM_H_
+
+// Shared between the compositor daemon (tftgld) and the client library.
+//
+// A client connects to the unix socket of the daemon and asks for a surface
+// (a rectangle of the screen). The daemon creates a memfd holding a
+// TftglShmSurface header followed by the RGB-565 pixels, and sends it back
+// together with an eventfd. The client draws straight into the pixels and
+// posts the damaged rectangles to the ring in the header, then writes the
+// eventfd to wake the daemon up. The daemon sends the damaged parts from
+// the shared pixels straight to the LCD, nothing is copied in between.
+
+#include <stdatomic.h>
+
+#define TFTGL_SHM_MAGIC 0x54465453 // "STFT"
+#define TFTGL_SHM_VERSION 1
+#define TFTGL_SHM_DEFAULT_SOCKET "/run/tftgld.sock"
+
+// Damage rectangles that fit the ring, the client marks the whole surface
+// damaged if the daemon falls behind
+#define TFTGL_SHM_RING 64
+
+// Head and tail on their own cache lines, one is written by the client and
+// the other one by the daemon
+#define TFTGL_SHM_LINE 64
+
+typedef struct TftglShmRectStruct {
+	unsigned short x;
+	unsigned short y;
+	unsigned short w;
+	unsigned short h;
+} TftglShmRect;
+
+// The ring is single producer (client) single consumer (daemon). The
+// client writes a rectangle and then publishes it by moving the head with
+// release order, the daemon reads the head with acquire order, reads the
+// rectangles and moves the tail. Counters only grow, the slot is the
+// counter modulo the ring size.
+typedef struct TftglShmSurfaceStruct {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int width;
+	unsigned int height;
+	unsigned int stride; // Pixels from one row to the next
+	unsigned int pixelsOffset; // Bytes from the start of the header
+	unsigned char pad0[TFTGL_SHM_LINE - 6 * sizeof(unsigned int)];
+	atomic_uint head;
+	atomic_uint overflow;
+	unsigned char pad1[TFTGL_SHM_LINE - 2 * sizeof(atomic_uint)];
+	atomic_uint tail;
+	unsigned char pad2[TFTGL_SHM_LINE - sizeof(atomic_uint)];
+	TftglShmRect rects[TFTGL_SHM_RING];
+} TftglShmSurface;
+
+// Messages on the socket (SOCK_SEQPACKET), one of each per connection.
+// The reply comes with the memfd and the eventfd as SCM_RIGHTS.
+typedef struct TftglShmRequestStruct {
+	unsigned int version;
+	unsigned int x;
+	unsigned int y;
+	unsigned int w;
+	unsigned int h;
+} TftglShmRequest;
+
+typedef struct TftglShmReplyStruct {
+	unsigned int status; // TFTGL_OK or a TFTGL_ error code
+	unsigned int screenWidth;
+	unsigned int screenHeight;
+	unsigned int size; // Bytes to map
+} TftglShmReply;
+
+#endif
@@ -0,0 +1,522 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// Add TFTGL library
+#include <tftgl.h>
+#include <tftgl_client.h>
+#include "tftgl_shm.h"
+
+// Compositor daemon. Owns the LCD and lets other processes draw to it
+// through the client library (tftgl_client.h). Every client has a surface
+// in shared memory, the damaged rectangles posted by the clients are
+// gathered for a frame and then sent straight from the surfaces, the
+// topmost surface wins where they overlap. Later surfaces are on top.
+//
+// Usage: tftgld [--socket PATH] [--flags N] [--fps N] [--background RRGGBB]
+
+#define TFTGLD_MAX_CLIENTS 8
+#define TFTGLD_MAX_EDGES (TFTGLD_MAX_CLIENTS * 2 + 2)
+// Connections that have not sent their request yet, and how long they get
+#define TFTGLD_MAX_PENDING 8
+#define TFTGLD_REQUEST_TIMEOUT 1000000 // us
+
+// epoll ids: client slot * 2 for its socket and slot * 2 + 1 for its
+// eventfd, then the pending connections and the listening socket
+#define TFTGLD_PENDING_ID (TFTGLD_MAX_CLIENTS * 2)
+#define TFTGLD_LISTEN_ID (~0u)
+#define TFTGLD_MAX_EVENTS (TFTGLD_MAX_CLIENTS * 2 + TFTGLD_MAX_PENDING + 1)
+
+typedef struct {
+	int sock;
+	int event;
+	TftglShmSurface* shm;
+	size_t size;
+	const unsigned short* pixels;
+	unsigned int x, y, w, h;
+	unsigned int stride;
+	unsigned int tail; // Our copy, the client can not move it
+} TftgldClient;
+
+typedef struct {
+	int sock; // -1 if free
+	unsigned long since;
+} TftgldPending;
+
+static TftgldClient clients[TFTGLD_MAX_CLIENTS];
+static unsigned int order[TFTGLD_MAX_CLIENTS]; // Slots from bottom to top
+static unsigned int clientCount = 0;
+static TftgldPending pending[TFTGLD_MAX_PENDING];
+static unsigned char background[3] = {0, 0, 0};
+static volatile sig_atomic_t quit = 0;
+static int epollFd = -1;
+
+static void tftgldSignal(int sig){
+	(void)sig;
+	quit = 1;
+}
+
+static unsigned long tftgldMicros(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+static void tftgldDamageSurface(const TftgldClient* c){
+	tftglAddDirtyRect(c->x, c->y, c->w, c->h);
+}
+
+// Reads the damage ring of a client, the rectangles are checked as the
+// client may write anything to the shared memory
+static void tftgldDrainDamage(TftgldClient* c){
+	TftglShmSurface* shm = c->shm;
+	unsigned int head = atomic_load_explicit(&shm->head, memory_order_acquire);
+
+	if(atomic_exchange_explicit(&shm->overflow, 0, memory_order_acquire) ||
+		head - c->tail > TFTGL_SHM_RING){
+		tftgldDamageSurface(c);
+		c->tail = head;
+	}
+
+	for(; c->tail != head; c->tail++){
+		TftglShmRect r = shm->rects[c->tail % TFTGL_SHM_RING];
+		unsigned int w = r.w, h = r.h;
+		if(r.x >= c->w || r.y >= c->h)continue;
+		if(w > c->w - r.x)w = c->w - r.x;
+		if(h > c->h - r.y)h = c->h - r.y;
+		tftglAddDirtyRect(c->x + r.x, c->y + r.y, w, h);
+	}
+	atomic_store_explicit(&shm->tail, c->tail, memory_order_release);
+}
+
+// Returns the slot of the topmost surface with the pixel, or -1
+static int tftgldOwner(unsigned int x, unsigned int y){
+	unsigned int i;
+	for(i = clientCount; i-- > 0;){
+		const TftgldClient* c = &clients[order[i]];
+		if(x >= c->x && x < c->x + c->w && y >= c->y && y < c->y + c->h)return order[i];
+	}
+	return -1;
+}
+
+// Adds an edge if it is inside of the range, keeps the edges sorted
+static void tftgldAddEdge(unsigned int* edges, unsigned int* count, unsigned int e,
+	unsigned int start, unsigned int end){
+	unsigned int i, j;
+	if(e <= start || e >= end)return;
+	for(i = 0; i < *count && edges[i] < e; i++);
+	if(i < *count && edges[i] == e)return;
+	for(j = *count; j > i; j--)edges[j] = edges[j - 1];
+	edges[i] = e;
+	(*count)++;
+}
+
+static void tftgldSend(int owner, unsigned int x, unsigned int y, unsigned int w, unsigned int h){
+	if(owner < 0){
+		tftglFillColor(x, y, w, h, background);
+	} else {
+		const TftgldClient* c = &clients[owner];
+		tftglPushPixels565(x, y, w, h, &c->pixels[(y - c->y) * c->stride + (x - c->x)], c->stride);
+	}
+}
+
+// Splits a damaged rectangle at the edges of the surfaces into bands of
+// rows and the bands into runs of columns that have the same topmost
+// surface, each run is sent from the pixels of that surface
+static void tftgldCompose(const TftglRect* d){
+	unsigned int ys[TFTGLD_MAX_EDGES], xs[TFTGLD_MAX_EDGES];
+	unsigned int yCount = 2, xCount, i, b, k;
+
+	ys[0] = d->y;
+	ys[1] = d->y + d->h;
+	for(i = 0; i < clientCount; i++){
+		const TftgldClient* c = &clients[order[i]];
+		tftgldAddEdge(ys, &yCount, c->y, ys[0], ys[yCount - 1]);
+		tftgldAddEdge(ys, &yCount, c->y + c->h, ys[0], ys[yCount - 1]);
+	}
+
+	for(b = 0; b + 1 < yCount; b++){
+		unsigned int y0 = ys[b], bandH = ys[b + 1] - ys[b];
+		unsigned int start;
+		int owner;
+
+		// Every surface covers the band either fully or not at all
+		xCount = 2;
+		xs[0] = d->x;
+		xs[1] = d->x + d->w;
+		for(i = 0; i < clientCount; i++){
+			const TftgldClient* c = &clients[order[i]];
+			if(c->y > y0 || c->y + c->h <= y0)continue;
+			tftgldAddEdge(xs, &xCount, c->x, xs[0], xs[xCount - 1]);
+			tftgldAddEdge(xs, &xCount, c->x + c->w, xs[0], xs[xCount - 1]);
+		}
+
+		start = xs[0];
+		owner = tftgldOwner(xs[0], y0);
+		for(k = 1; k < xCount; k++){
+			int next = (k + 1 < xCount ? tftgldOwner(xs[k], y0) : -2);
+			if(next != owner){
+				tftgldSend(owner, start, y0, xs[k] - start, bandH);
+				start = xs[k];
+				owner = next;
+			}
+		}
+	}
+}
+
+static void tftgldComposeDirty(){
+	TftglRect rects[32];
+	unsigned int i, n = tftglGetDirtyRects(rects, 32);
+	tftglClearDirtyRects();
+	for(i = 0; i < n; i++)tftgldCompose(&rects[i]);
+}
+
+static void tftgldRemove(unsigned int slot){
+	TftgldClient* c = &clients[slot];
+	unsigned int i, j;
+
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, c->sock, NULL);
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, c->event, NULL);
+	close(c->sock);
+	close(c->event);
+	munmap(c->shm, c->size);
+	c->shm = NULL;
+
+	for(i = 0, j = 0; i < clientCount; i++){
+		if(order[i] != slot)order[j++] = order[i];
+	}
+	clientCount = j;
+
+	// Whatever was below shows up again
+	tftgldDamageSurface(c);
+}
+
+static unsigned int tftgldCreateSurface(TftgldClient* c, const TftglShmRequest* req, int* memfd,
+	unsigned int* size){
+	size_t headerSize = (sizeof(TftglShmSurface) + TFTGL_SHM_LINE - 1) & ~(size_t)(TFTGL_SHM_LINE - 1);
+	void* map;
+
+	if(req->version != TFTGL_SHM_VERSION)return TFTGL_CLIENT_BAD_VERSION;
+	if(req->w == 0 || req->h == 0 || req->x >= tftglGetWidth() || req->y >= tftglGetHeight() ||
+		req->w > tftglGetWidth() - req->x || req->h > tftglGetHeight() - req->y){
+		return TFTGL_CLIENT_BAD_AREA;
+	}
+
+	c->x = req->x;
+	c->y = req->y;
+	c->w = req->w;
+	c->h = req->h;
+	c->stride = req->w;
+	c->size = headerSize + (size_t)c->stride * c->h * sizeof(unsigned short);
+
+	// Sealed, so the client can not shrink it under our feet
+	*memfd = memfd_create("tftgld-surface", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if(*memfd < 0)return TFTGL_CLIENT_OUT_OF_MEM;
+	if(ftruncate(*memfd, c->size) != 0 ||
+		fcntl(*memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0){
+		return TFTGL_CLIENT_OUT_OF_MEM;
+	}
+	map = mmap(NULL, c->size, PROT_READ | PROT_WRITE, MAP_SHARED, *memfd, 0);
+	if(map == MAP_FAILED)return TFTGL_CLIENT_OUT_OF_MEM;
+
+	c->shm = map;
+	c->shm->magic = TFTGL_SHM_MAGIC;
+	c->shm->version = TFTGL_SHM_VERSION;
+	c->shm->width = c->w;
+	c->shm->height = c->h;
+	c->shm->stride = c->stride;
+	c->shm->pixelsOffset = headerSize;
+	atomic_init(&c->shm->head, 0);
+	atomic_init(&c->shm->overflow, 0);
+	atomic_init(&c->shm->tail, 0);
+	c->pixels = (const unsigned short*)((unsigned char*)map + headerSize);
+	c->tail = 0;
+
+	c->event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(c->event < 0){
+		munmap(c->shm, c->size);
+		c->shm = NULL;
+		return TFTGL_CLIENT_OUT_OF_MEM;
+	}
+	*size = c->size;
+	return TFTGL_OK;
+}
+
+static void tftgldDropPending(unsigned int index){
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, pending[index].sock, NULL);
+	close(pending[index].sock);
+	pending[index].sock = -1;
+}
+
+// The socket is world writable, a connection only gets a slot once its
+// request is read. Until then it waits in epoll like the clients do, so a
+// connection that never sends anything can not stall the daemon.
+static void tftgldAccept(int listenFd){
+	struct epoll_event ev;
+	unsigned int i, index = 0;
+	int sock;
+
+	sock = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	if(sock < 0)return;
+
+	// Make room by dropping the connection that waited longest
+	for(i = 0; i < TFTGLD_MAX_PENDING; i++){
+		if(pending[i].sock < 0){
+			index = i;
+			break;
+		}
+		if(pending[i].since < pending[index].since)index = i;
+	}
+	if(pending[index].sock >= 0)tftgldDropPending(index);
+
+	ev.events = EPOLLIN;
+	ev.data.u32 = TFTGLD_PENDING_ID + index;
+	if(epoll_ctl(epollFd, EPOLL_CTL_ADD, sock, &ev) != 0){
+		close(sock);
+		return;
+	}
+	pending[index].sock = sock;
+	pending[index].since = tftgldMicros();
+}
+
+// Drops the connections that did not send their request in time, returns
+// the epoll timeout (ms) until the next one is due, or -1 if none waits
+static int tftgldExpirePending(unsigned long now){
+	unsigned long due, next = 0;
+	unsigned int i;
+
+	for(i = 0; i < TFTGLD_MAX_PENDING; i++){
+		if(pending[i].sock < 0)continue;
+		due = pending[i].since + TFTGLD_REQUEST_TIMEOUT;
+		if(due <= now){
+			tftgldDropPending(i);
+		} else if(next == 0 || due < next){
+			next = due;
+		}
+	}
+	return (next == 0 ? -1 : (int)((next - now + 999) / 1000));
+}
+
+// Reads the request of a pending connection and creates its surface
+static void tftgldRequest(unsigned int index){
+	TftglShmRequest req;
+	TftglShmReply reply;
+	struct epoll_event ev;
+	struct msghdr msg;
+	struct iovec iov;
+	union {
+		char buf[CMSG_SPACE(2 * sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	int sock = pending[index].sock, memfd = -1;
+	ssize_t n;
+	unsigned int slot;
+	TftgldClient* c = NULL;
+
+	n = recv(sock, &req, sizeof(req), MSG_DONTWAIT);
+	if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))return;
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, sock, NULL);
+	pending[index].sock = -1;
+	if(n != sizeof(req)){
+		close(sock);
+		return;
+	}
+
+	memset(&reply, 0, sizeof(reply));
+	reply.screenWidth = tftglGetWidth();
+	reply.screenHeight = tftglGetHeight();
+
+	for(slot = 0; slot < TFTGLD_MAX_CLIENTS && clients[slot].shm != NULL; slot++);
+	if(slot == TFTGLD_MAX_CLIENTS){
+		reply.status = TFTGL_CLIENT_TOO_MANY;
+	} else {
+		c = &clients[slot];
+		reply.status = tftgldCreateSurface(c, &req, &memfd, &reply.size);
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &reply;
+	iov.iov_len = sizeof(reply);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if(reply.status == TFTGL_OK){
+		int fds[2] = {memfd, c->event};
+		struct cmsghdr* cmsg;
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	}
+	if(memfd >= 0 && reply.status != TFTGL_OK){
+		close(memfd);
+		memfd = -1;
+	}
+
+	if(sendmsg(sock, &msg, MSG_NOSIGNAL) != sizeof(reply) || reply.status != TFTGL_OK){
+		if(reply.status == TFTGL_OK){
+			munmap(c->shm, c->size);
+			c->shm = NULL;
+			close(c->event);
+		}
+		if(memfd >= 0)close(memfd);
+		close(sock);
+		return;
+	}
+	// The mapping stays, the client has its own copy of the descriptor
+	close(memfd);
+
+	c->sock = sock;
+	ev.events = EPOLLIN;
+	ev.data.u32 = slot * 2;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, sock, &ev);
+	ev.data.u32 = slot * 2 + 1;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, c->event, &ev);
+
+	order[clientCount++] = slot;
+	tftgldDamageSurface(c);
+}
+
+static int tftgldListen(const char* path){
+	struct sockaddr_un addr;
+	int fd;
+
+	if(strlen(path) >= sizeof(addr.sun_path))return -1;
+	fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if(fd < 0)return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0){
+		close(fd);
+		return -1;
+	}
+	// The daemon runs as root for the GPIO, the clients do not have to
+	chmod(path, 0666);
+	return fd;
+}
+
+//==============================================================================
+int main(int argv, char** argc){
+	const char* socketPath = TFTGL_SHM_DEFAULT_SOCKET;
+	unsigned int flags = TFTGL_LANDSCAPE;
+	unsigned long period = 0, nextFrame = 0;
+	struct epoll_event ev, events[TFTGLD_MAX_EVENTS];
+	struct sigaction sa;
+	int listenFd, i, n;
+
+	for(i = 1; i < argv; i++){
+		if(strcmp(argc[i], "--socket") == 0 && i + 1 < argv){
+			socketPath = argc[++i];
+		} else if(strcmp(argc[i], "--flags") == 0 && i + 1 < argv){
+			flags = strtoul(argc[++i], NULL, 0);
+		} else if(strcmp(argc[i], "--fps") == 0 && i + 1 < argv){
+			unsigned long fps = strtoul(argc[++i], NULL, 0);
+			period = (fps > 0 ? 1000000UL / fps : 0);
+		} else if(strcmp(argc[i], "--background") == 0 && i + 1 < argv){
+			unsigned long rgb = strtoul(argc[++i], NULL, 16);
+			background[0] = rgb >> 16;
+			background[1] = rgb >> 8;
+			background[2] = rgb;
+		} else {
+			fprintf(stderr, "Usage: %s [--socket PATH] [--flags N] [--fps N] [--background RRGGBB]\n", argc[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Initialize tftgl!
+	if(tftglInit(flags) != TFTGL_OK){
+		fprintf(stderr, "Failed to initialize TFTGL library! Error: %s\n",
+			tftglGetErrorStr());
+		return EXIT_FAILURE;
+	}
+	tftglFillColor(0, 0, tftglGetWidth(), tftglGetHeight(), background);
+
+	listenFd = tftgldListen(socketPath);
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if(listenFd < 0 || epollFd < 0){
+		fprintf(stderr, "Failed to listen on %s!\n", socketPath);
+		tftglTerminate();
+		return EXIT_FAILURE;
+	}
+	ev.events = EPOLLIN;
+	ev.data.u32 = TFTGLD_LISTEN_ID;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+	for(i = 0; i < TFTGLD_MAX_PENDING; i++)pending[i].sock = -1;
+
+	// Without SA_RESTART, so epoll_wait returns
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = tftgldSignal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	while(!quit){
+		unsigned long now = tftgldMicros();
+		int timeout = tftgldExpirePending(now);
+
+		// Damage waits for the next frame
+		if(tftglGetDirtyRects(NULL, 0) > 0){
+			int frame = (nextFrame > now ? (int)((nextFrame - now + 999) / 1000) : 0);
+			if(timeout < 0 || frame < timeout)timeout = frame;
+		}
+
+		n = epoll_wait(epollFd, events, TFTGLD_MAX_EVENTS, timeout);
+		if(n < 0 && errno != EINTR)break;
+
+		for(i = 0; i < n; i++){
+			unsigned int id = events[i].data.u32;
+			if(id == TFTGLD_LISTEN_ID){
+				tftgldAccept(listenFd);
+			} else if(id >= TFTGLD_PENDING_ID){
+				if(pending[id - TFTGLD_PENDING_ID].sock >= 0)tftgldRequest(id - TFTGLD_PENDING_ID);
+			} else if(clients[id / 2].shm == NULL){
+				// Removed earlier in this batch
+			} else if(id & 1){
+				uint64_t count;
+				if(read(clients[id / 2].event, &count, sizeof(count)) < 0){
+					// Nothing to read, woken up by someone else
+				}
+			} else {
+				// Clients send nothing after the request, so this is a hang up
+				tftgldRemove(id / 2);
+			}
+		}
+
+		for(i = 0; i < (int)clientCount; i++)tftgldDrainDamage(&clients[order[i]]);
+
+		if(tftglGetDirtyRects(NULL, 0) > 0){
+			now = tftgldMicros();
+			if(now >= nextFrame){
+				tftgldComposeDirty();
+				nextFrame = now + period;
+			}
+		}
+	}
+
+	while(clientCount > 0)tftgldRemove(order[clientCount - 1]);
+	for(i = 0; i < TFTGLD_MAX_PENDING; i++){
+		if(pending[i].sock >= 0)tftgldDropPending(i);
+	}
+	close(listenFd);
+	unlink(socketPath);
+	close(epollFd);
+	tftglTerminate();
+	return EXIT_SUCCESS;
+}
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "kbhit.h"
 
 // Add TFTGL library
@@ -12,14 +13,31 @@
 
 //==============================================================================
 int main(int argv, char** argc){
-	unsigned int x, y, z;
+	unsigned int x, y;
 	unsigned int i;
 	unsigned int width, height;
-	unsigned int calibData[4][2];
-	unsigned int calibXMin, calibXMax, calibYMin, calibYMax;
+	unsigned int headless = 0;
+	unsigned int count = 5;
+	const char* profile = NULL;
+	TftglCalibrationPoint points[5];
+	TftglTouchCalibration calib;
+	
+	// Use --headless to only render the calibration points without the
+	// display and touch screen (no GPIO needed), --points 3 for three
+	// points instead of five and --save <file> to store the profile for
+	// tftglLoadTouchCalibration()
+	for(i = 1; i < (unsigned int)argv; i++){
+		if(strcmp(argc[i], "--headless") == 0){
+			headless = 1;
+		} else if(strcmp(argc[i], "--points") == 0 && i + 1 < (unsigned int)argv){
+			count = atoi(argc[++i]) == 3 ? 3 : 5;
+		} else if(strcmp(argc[i], "--save") == 0 && i + 1 < (unsigned int)argv){
+			profile = argc[++i];
+		}
+	}
 	
 	// Initialize tftgl!
-	if(tftglInit(TFTGL_LANDSCAPE) != TFTGL_OK){
+	if(tftglInit(TFTGL_LANDSCAPE | (headless ? TFTGL_HEADLESS : 0)) != TFTGL_OK){
 		fprintf(stderr, "Failed to initialize TFTGL library! Error: %s\n",
 			tftglGetErrorStr());
 		return EXIT_FAILURE;
@@ -43,16 +61,26 @@ int main(int argv, char** argc){
 	
 	struct NVGcontext* vg = nvgCreateGLES2(NVG_ANTIALIAS | NVG_STENCIL_STROKES);
 	
-	// Four points on the screen, each 10% from the edges
-	unsigned int pos[4][2] = {
+	// Five points, the corners each 10% from the edges and the center.
+	// Three points are enough for the matrix, the more points the less
+	// an inaccurate touch matters.
+	unsigned int pos5[5][2] = {
 		{ width / 10, height / 10}, // 10% X and 10% Y
 		{ width - width / 10, height / 10}, // 90% X and 10% Y
 		{ width - width / 10, height - height / 10}, // 90% X and 90% Y
 		{ width / 10, height - height / 10}, // 10% X and 90% Y
+		{ width / 2, height / 2}, // Center
+	};
+	// Three points far from a line
+	unsigned int pos3[3][2] = {
+		{ width / 10, height / 10}, // 10% X and 10% Y
+		{ width - width / 10, height / 2}, // 90% X and 50% Y
+		{ width / 2, height - height / 10}, // 50% X and 90% Y
 	};
+	unsigned int (*pos)[2] = count == 3 ? pos3 : pos5;
 	
-	// Render the 4 points
-	for(i = 0; i < 4; i++){
+	// Render the points
+	for(i = 0; i < count; i++){
 		printf("Press the red dot on the screen.\n");
 		printf("Press any key on the keyboard to terminate!\n");
 		
@@ -70,6 +98,13 @@ int main(int argv, char** argc){
 		nvgEndFrame(vg);
 		tftglUploadFbo();
 		
+		if(headless){
+			TftglStats stats;
+			tftglGetStats(&stats);
+			printf("Frame render: %lu us, read: %lu us\n", stats.renderMicros, stats.readMicros);
+			continue;
+		}
+		
 		// Wait for touch
 		while(1){
 			// Keyboard press detected, terminate application!
@@ -92,38 +127,49 @@ int main(int argv, char** argc){
 			}
 		}
 		
-		calibData[i][0] = x;
-		calibData[i][1] = y;
+		points[i].rawX = x;
+		points[i].rawY = y;
+		points[i].x = pos[i][0];
+		points[i].y = pos[i][1];
 	}
 	
-	// Min X is composed from left points (top left, bottom left)
-	// Max X is composed from right points (top right, bottom right)
-	calibXMin = (calibData[0][0] + calibData[3][0]) / 2;
-	calibXMax = (calibData[1][0] + calibData[2][0]) / 2;
+	// There is no touch screen to calibrate
+	if(headless){
+		nvgDeleteGLES2(vg);
+		tftglTerminate();
+		return EXIT_SUCCESS;
+	}
 	
-	// Min Y is composed from top points (top left, top right)
-	// Max Y is composed from bottom points (bottom left, bottom right)
-	calibYMin = (calibData[0][1] + calibData[1][1]) / 2;
-	calibYMax = (calibData[2][1] + calibData[3][1]) / 2;
+	// Solve the matrix and use it for tftglGetTouch()
+	if(tftglCalibrateTouch(points, count) != TFTGL_OK){
+		fprintf(stderr, "Failed to calibrate! Error: %s\n", tftglGetErrorStr());
+		fprintf(stderr, "Touch the dots more carefully and try again.\n");
+		nvgDeleteGLES2(vg);
+		tftglTerminate();
+		return EXIT_FAILURE;
+	}
+	tftglGetTouchMatrix(&calib);
 	
 	printf("Calibration data:\n");
-	printf("X min: %d at pos: %d\n", calibXMin, pos[0][0]);
-	printf("X max: %d at pos: %d\n", calibXMax, pos[1][0]);
-	printf("Y min: %d at pos: %d\n", calibYMin, pos[0][1]);
-	printf("Y max: %d at pos: %d\n", calibYMax, pos[3][1]);
-	printf("Add the following into your code:\n");
-
-    printf("tftglSetTouchCalibration(TFTGL_CALIB_MIN_X, %d, %d);\n", calibXMin, pos[0][0]);
-    printf("tftglSetTouchCalibration(TFTGL_CALIB_MAX_X, %d, %d);\n", calibXMax, pos[1][0]);
-    printf("tftglSetTouchCalibration(TFTGL_CALIB_MIN_Y, %d, %d);\n", calibYMin, pos[0][1]);
-    printf("tftglSetTouchCalibration(TFTGL_CALIB_MAX_Y, %d, %d);\n", calibYMax, pos[3][1]);
-    printf("This is hardware specific data! You will need to include this\n");
-    printf("in your program in order to use the touchscreen!\n");
-
-	tftglSetTouchCalibration(TFTGL_CALIB_MIN_X, calibXMin, pos[0][0]); // 3617
-	tftglSetTouchCalibration(TFTGL_CALIB_MAX_X, calibXMax, pos[1][0]); // 430
-	tftglSetTouchCalibration(TFTGL_CALIB_MIN_Y, calibYMin, pos[0][1]); // 3543
-	tftglSetTouchCalibration(TFTGL_CALIB_MAX_Y, calibYMax, pos[3][1]); // 812
+	for(i = 0; i < count; i++){
+		printf("Raw %u, %u at pos: %u, %u\n", points[i].rawX, points[i].rawY, points[i].x, points[i].y);
+	}
+	
+	if(profile != NULL){
+		if(tftglSaveTouchCalibration(profile) != TFTGL_OK){
+			fprintf(stderr, "Failed to save %s! Error: %s\n", profile, tftglGetErrorStr());
+		} else {
+			printf("Saved to %s, load it in your code with:\n", profile);
+			printf("tftglLoadTouchCalibration(\"%s\");\n", profile);
+		}
+	}
+	
+	printf("Or add the following into your code:\n");
+	printf("TftglTouchCalibration calib = {%d, %d, %d, %d, %d, %d};\n",
+		calib.a, calib.b, calib.c, calib.d, calib.e, calib.f);
+	printf("tftglSetTouchMatrix(&calib);\n");
+	printf("This is hardware specific data! You will need to include this\n");
+	printf("in your program in order to use the touchscreen!\n");
 	
 	// Run forever
     int gotTouch = 0;
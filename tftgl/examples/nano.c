@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/time.h> 
 
 // Add TFTGL library
@@ -16,9 +17,15 @@ static const double graphSamples[6] = {0.2, 0.4, 0.45, 0.6, 0.7, 0.5};
 int main(int argv, char** argc){
 	double pxRatio;
 	unsigned int i;
+	unsigned int flags = TFTGL_LANDSCAPE;
+	
+	// Use --headless to render without the display (no GPIO needed)
+	if(argv > 1 && strcmp(argc[1], "--headless") == 0){
+		flags |= TFTGL_HEADLESS;
+	}
 	
 	// Initialize tftgl!
-	if(tftglInit(TFTGL_LANDSCAPE) != TFTGL_OK){
+	if(tftglInit(flags) != TFTGL_OK){
 		fprintf(stderr, "Failed to initialize TFTGL library! Error: %s\n",
 			tftglGetErrorStr());
 		return EXIT_FAILURE;
@@ -106,6 +113,12 @@ int main(int argv, char** argc){
 	// Copy pixesl from OpenGL buffer into TFT LCD Display (time costly!)
 	tftglUploadFbo();
 	
+	// Where did the time go?
+	TftglStats stats;
+	tftglGetStats(&stats);
+	printf("Frame read: %lu us, sent to the display: %lu us\n",
+		stats.readMicros, stats.pushMicros);
+	
 	nvgDeleteGLES2(vg);
 	
 	// Terminates everything (GPIO, LCD, and EGL)
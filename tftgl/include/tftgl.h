@@ -16,6 +16,11 @@ extern "C" {
 #define TFTGL_GOT_TOUCH (1)
 #define TFTGL_NO_TOUCH (0)
 
+// Touch event types
+#define TFTGL_TOUCH_DOWN (1)
+#define TFTGL_TOUCH_MOVE (2)
+#define TFTGL_TOUCH_UP (3)
+
 // Error codes
 #define TFTGL_GPIO_ERROR (2)
 #define TFTGL_SPI_ERROR (3)
@@ -28,18 +33,48 @@ extern "C" {
 #define TFTGL_BAD_WIDTH (10)
 #define TFTGL_BAD_HEIGHT (11)
 #define TFTGL_OUT_OF_MEM (12)
+#define TFTGL_BAD_SCROLL (13)
+#define TFTGL_NO_TEAR (14)
+#define TFTGL_BAD_IMAGE (15)
+#define TFTGL_NO_TOUCH_IRQ (16)
+#define TFTGL_BAD_CALIB (17)
+#define TFTGL_FILE_ERROR (18)
 
 // Flags
 #define TFTGL_LANDSCAPE (0x0)
 #define TFTGL_PORTRAIT (0x1)
 #define TFTGL_ROTATE_180 (0x2)
 #define TFTGL_MSAA (0x4)
+#define TFTGL_FRAME_DIFF (0x8)
+#define TFTGL_RGB565 (0x20)
+#define TFTGL_PACK_565 (0x40)
+#define TFTGL_HEADLESS (0x80)
+#define TFTGL_BOTTOM_UP (0x100)
+#define TFTGL_TEAR_SYNC (0x200)
+#define TFTGL_WARM_START (0x400)
+#define TFTGL_NO_CLEAR (0x800)
+#define TFTGL_DUAL_PANEL (0x4000)
+#define TFTGL_INTERLEAVE (0x8000)
+#define TFTGL_TOUCH_IRQ (0x10000)
+#define TFTGL_TOUCH_THREAD (0x20000)
+
+// Panel drivers (flags)
+#define TFTGL_DRIVER_SSD1963 (0x0)
+#define TFTGL_DRIVER_ILI9341 (0x1000)
+#define TFTGL_DRIVER_ILI9486 (0x2000)
+#define TFTGL_DRIVER_ST7796 (0x3000)
+#define TFTGL_DRIVER_MASK (0x3000)
 
 #define TFTGL_CALIB_MIN_X (0)
 #define TFTGL_CALIB_MAX_X (1)
 #define TFTGL_CALIB_MIN_Y (2)
 #define TFTGL_CALIB_MAX_Y (3)
 
+// Combining the samples of a touch reading, see tftglSetTouchFilter
+#define TFTGL_TOUCH_MEAN (0)
+#define TFTGL_TOUCH_MEDIAN (1)
+#define TFTGL_TOUCH_TRIMMED (2)
+
 typedef struct TftglEglDataStruct {
 	EGLDisplay display;
 	EGLConfig config;
@@ -49,6 +84,99 @@ typedef struct TftglEglDataStruct {
 	int versionMinor;
 } TftglEglData;
 
+typedef struct TftglRectStruct {
+	unsigned int x;
+	unsigned int y;
+	unsigned int w;
+	unsigned int h;
+} TftglRect;
+
+typedef struct TftglStatsStruct {
+	unsigned long pixels;
+	unsigned long busWritesElided;
+	unsigned long uploads;
+	unsigned long renderMicros;
+	unsigned long readMicros;
+	unsigned long pushMicros;
+	unsigned long waitMicros;
+	unsigned long missedFrames;
+	unsigned long touchConversions;
+	unsigned long touchMicros;
+} TftglStats;
+
+// Touch event of the sampler thread, see tftglGetTouchEvent
+typedef struct TftglTouchEventStruct {
+	unsigned int type;
+	unsigned int x;
+	unsigned int y;
+	unsigned long micros; // CLOCK_MONOTONIC
+} TftglTouchEvent;
+
+// Latest reading of the sampler thread, see tftglGetTouchState
+typedef struct TftglTouchStateStruct {
+	unsigned int down;
+	unsigned int x;
+	unsigned int y;
+	unsigned long micros; // CLOCK_MONOTONIC
+} TftglTouchState;
+
+// Filter of the touch readings, see tftglSetTouchFilter
+typedef struct TftglTouchFilterStruct {
+	unsigned int samples; // Conversions of X and of Y per reading, 1 to 16
+	unsigned int combine; // TFTGL_TOUCH_MEAN, TFTGL_TOUCH_MEDIAN or TFTGL_TOUCH_TRIMMED
+	unsigned int maxResistance; // Skip lighter touches, 0 to keep all
+	float minCutoff; // 1-euro filter (Hz), 0 to turn it off
+	float beta; // How fast the 1-euro filter opens up with speed
+} TftglTouchFilter;
+
+// Touch calibration matrix in 16.16 fixed point, see tftglCalibrateTouch
+typedef struct TftglTouchCalibrationStruct {
+	int a, b, c; // x = (a * rawX + b * rawY + c) / 65536
+	int d, e, f; // y = (d * rawX + e * rawY + f) / 65536
+} TftglTouchCalibration;
+
+// Raw reading at a known pixel, see tftglCalibrateTouch
+typedef struct TftglCalibrationPointStruct {
+	unsigned int rawX;
+	unsigned int rawY;
+	unsigned int x;
+	unsigned int y;
+} TftglCalibrationPoint;
+
+// RGB-565 image sent to the LCD as rectangles of opaque pixels, see
+// tftglCreateSprite
+typedef struct TftglSpriteStruct {
+	unsigned int width;
+	unsigned int height;
+	unsigned short* pixels;
+	TftglRect* spans;
+	unsigned int spanCount;
+} TftglSprite;
+
+// Counters returned by tftglGetVideoStats
+typedef struct TftglVideoStatsStruct {
+	unsigned long decoded;
+	unsigned long shown;
+	unsigned long dropped;
+	unsigned long decodeMicros;
+	unsigned long pushMicros;
+} TftglVideoStats;
+
+// Simulator types (only with BACKEND=sim)
+typedef struct TftglSimTouchStruct {
+	unsigned int x;
+	unsigned int y;
+	unsigned int z;
+	unsigned int conversions;
+} TftglSimTouch;
+
+typedef struct TftglSimStatsStruct {
+	unsigned long gpioWrites;
+	unsigned long wrPulses;
+	unsigned long commands;
+	unsigned long conversions;
+} TftglSimStats;
+
 // Common TFTGL functions
 extern unsigned int tftglInit(unsigned int flags);
 extern void tftglTerminate();
@@ -56,16 +184,44 @@ extern unsigned int tftglGetWidth();
 extern unsigned int tftglGetHeight();
 extern unsigned int tftglGetError();
 extern const char* tftglGetErrorStr();
+extern void tftglGetStats(TftglStats* stats);
 
 // LCD functions
 extern void tftgSetBrightness(unsigned char val);
+extern void tftglFillColor(unsigned int x, unsigned int y, 
+	unsigned int w, unsigned int h, 
+	const unsigned char* color);
 extern void tftglFillPixels(unsigned int x, unsigned int y, 
 	unsigned int w, unsigned int h, 
 	const unsigned char* pixels);
+extern void tftglFillPixels565(unsigned int x, unsigned int y, 
+	unsigned int w, unsigned int h, 
+	const unsigned short* pixels);
+extern void tftglPushPixels565(unsigned int x, unsigned int y, 
+	unsigned int w, unsigned int h, 
+	const unsigned short* pixels, unsigned int stride);
+extern unsigned int tftglSetScrollArea(unsigned int top, unsigned int bottom);
+extern void tftglScroll(int lines);
+extern unsigned int tftglGetScrollOffset();
+extern unsigned int tftglGetScrollExposed(TftglRect* rect);
 extern void tftglGetTouchRaw(unsigned int* x, unsigned int* y, unsigned int* z);
 extern unsigned int tftglGetTouch(unsigned int* x, unsigned int* y);
 extern void tftglSetTouchSensitivity(unsigned int val);
+extern void tftglSetTouchFilter(const TftglTouchFilter* filter);
+extern void tftglGetTouchFilter(TftglTouchFilter* filter);
+extern void tftglGetTouchSamples(unsigned int* samples, unsigned int n);
 extern void tftglSetTouchCalibration(unsigned int which, unsigned int val, unsigned int pos);
+extern unsigned int tftglCalibrateTouch(const TftglCalibrationPoint* points, unsigned int count);
+extern unsigned int tftglSolveTouchCalibration(const TftglCalibrationPoint* points, unsigned int count,
+	TftglTouchCalibration* calib);
+extern void tftglSetTouchMatrix(const TftglTouchCalibration* calib);
+extern void tftglGetTouchMatrix(TftglTouchCalibration* calib);
+extern unsigned int tftglSaveTouchCalibration(const char* filename);
+extern unsigned int tftglLoadTouchCalibration(const char* filename);
+extern int tftglGetTouchFd();
+extern unsigned int tftglGetTouchEvent(TftglTouchEvent* event, int timeout);
+extern void tftglGetTouchState(TftglTouchState* state);
+extern void tftglSetTouchRate(unsigned int rate);
 
 // EGL/OpenGL ES functions
 extern unsigned int tftglEglMakeCurrent();
@@ -74,6 +230,46 @@ extern TftglEglData* tftglGetEglData();
 extern void tftglUploadFbo();
 extern void tftglUploadFboArea(unsigned int x, unsigned int y, 
 	unsigned int w, unsigned int h);
+extern unsigned int tftglUploadFboAsync();
+extern unsigned int tftglUploadFboAreaAsync(unsigned int x, unsigned int y, 
+	unsigned int w, unsigned int h);
+extern void tftglWaitUpload();
+extern void tftglSetUploadCpu(int cpu);
+extern void tftglSetFrameRate(unsigned int fps);
+
+// Damage tracking functions
+extern void tftglAddDirtyRect(unsigned int x, unsigned int y, 
+	unsigned int w, unsigned int h);
+extern void tftglClearDirtyRects();
+extern unsigned int tftglGetDirtyRects(TftglRect* rects, unsigned int max);
+extern void tftglUploadFboDirty();
+
+// Sprite functions
+extern TftglSprite* tftglCreateSprite(const unsigned char* rgba, unsigned int w, unsigned int h, 
+	unsigned int keyed);
+extern TftglSprite* tftglLoadSprite(const char* filename, unsigned int keyed);
+extern void tftglFreeSprite(TftglSprite* sprite);
+extern void tftglDrawSprite(const TftglSprite* sprite, unsigned int x, unsigned int y);
+
+// Layer functions
+extern unsigned int tftglCacheBackground();
+extern unsigned int tftglBeginOverlay();
+extern void tftglUploadOverlay();
+
+// Video functions
+extern unsigned int tftglPlayVideo(const char* filename, unsigned int x, unsigned int y, 
+	unsigned int fps, unsigned int loop);
+extern unsigned int tftglIsVideoPlaying();
+extern void tftglStopVideo();
+extern void tftglGetVideoStats(TftglVideoStats* stats);
+
+// Simulator functions (only with BACKEND=sim)
+extern const unsigned short* tftglSimGetPanel();
+extern const unsigned short* tftglSimGetPanelAt(unsigned int index);
+extern void tftglSimGetPanelSize(unsigned int* width, unsigned int* height);
+extern void tftglSimSetTouch(unsigned int x, unsigned int y, unsigned int z);
+extern void tftglSimSetTouchScript(const TftglSimTouch* script, unsigned int count);
+extern void tftglSimGetStats(TftglSimStats* stats);
 
 #ifdef __cplusplus
 }
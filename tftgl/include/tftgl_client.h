@@ -0,0 +1,56 @@
+#ifndef _TFTGL_CLIENT_LIB_H_
+#define _TFTGL_CLIENT_LIB_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Client of the tftgld compositor daemon, link with -ltftglclient. The
+// daemon owns the LCD, any number of processes can draw to their own
+// surface (a rectangle of the screen) at the same time.
+
+// Return values, the same as in tftgl.h
+#ifndef TFTGL_ERROR
+#define TFTGL_ERROR (0)
+#define TFTGL_OK (1)
+#endif
+
+// Error codes
+#define TFTGL_CLIENT_NO_DAEMON (100)
+#define TFTGL_CLIENT_BAD_AREA (101)
+#define TFTGL_CLIENT_BAD_VERSION (102)
+#define TFTGL_CLIENT_OUT_OF_MEM (103)
+#define TFTGL_CLIENT_TOO_MANY (104)
+
+typedef struct TftglClientStruct TftglClient;
+
+// Common functions
+extern TftglClient* tftglClientConnect(const char* socket, unsigned int x, unsigned int y,
+	unsigned int w, unsigned int h);
+extern void tftglClientDisconnect(TftglClient* client);
+extern unsigned int tftglClientGetWidth(const TftglClient* client);
+extern unsigned int tftglClientGetHeight(const TftglClient* client);
+extern unsigned int tftglClientGetScreenWidth(const TftglClient* client);
+extern unsigned int tftglClientGetScreenHeight(const TftglClient* client);
+extern unsigned int tftglClientGetError();
+extern const char* tftglClientGetErrorStr();
+
+// Drawing functions, coordinates are relative to the surface
+extern void tftglClientFillColor(TftglClient* client, unsigned int x, unsigned int y,
+	unsigned int w, unsigned int h,
+	const unsigned char* color);
+extern void tftglClientFillPixels(TftglClient* client, unsigned int x, unsigned int y,
+	unsigned int w, unsigned int h,
+	const unsigned char* pixels);
+extern void tftglClientFillPixels565(TftglClient* client, unsigned int x, unsigned int y,
+	unsigned int w, unsigned int h,
+	const unsigned short* pixels);
+extern unsigned short* tftglClientGetPixels(TftglClient* client, unsigned int* stride);
+extern void tftglClientAddDamage(TftglClient* client, unsigned int x, unsigned int y,
+	unsigned int w, unsigned int h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
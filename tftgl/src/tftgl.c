@@ -1,37 +1,140 @@
+#define _GNU_SOURCE
 #include <tftgl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <EGL/eglext.h>
+
+// Not in every eglext.h
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+typedef EGLDisplay (*TftglGetPlatformDisplay)(EGLenum platform, void* nativeDisplay, const EGLint* attribs);
 
 unsigned int errorCode = TFTGL_OK;
 
+#ifdef TFTGL_SIM
+#include "tftgl_sim.h"
+#else
 #include "bcm2835.h"
+#endif
 
 static volatile uint32_t* gpioData = NULL;
 
+// Counters returned by tftglGetStats. The upload, touch and video threads
+// add to them as well, so every change is done under statsMutex.
+static TftglStats stats;
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define STATS_ADD(field, value) do { \
+	pthread_mutex_lock(&statsMutex); \
+	stats.field += (value); \
+	pthread_mutex_unlock(&statsMutex); \
+} while(0)
+
+// Monotonic time in microseconds, for the timing stats
+static unsigned long tftglMicros(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
 #define GPIO_GPFSET0 (BCM2835_GPSET0/4)
 #define GPIO_GPFCLR0 (BCM2835_GPCLR0/4)
+#define GPIO_GPLEV0 (BCM2835_GPLEV0/4)
  
+#ifdef TFTGL_SIM
+#define GPIO_WRITE_REG(reg, value) tftglSimWriteReg(reg, value)
+#define GPIO_READ_REG(reg) tftglSimReadReg(reg)
+#else
+#define GPIO_WRITE_REG(reg, value) *(gpioData + (reg)) = (value)
+#define GPIO_READ_REG(reg) (*(gpioData + (reg)))
+#endif
+
 #define GPIO_WRITE_PIN(pinnum, pinstate) \
-	*(gpioData + (pinstate ? GPIO_GPFSET0 : GPIO_GPFCLR0)) = (1 << pinnum) ;
+	GPIO_WRITE_REG((pinstate ? GPIO_GPFSET0 : GPIO_GPFCLR0), (1 << pinnum)) ;
 
 #define PULSE_LOW(reg) GPIO_WRITE_PIN(reg, LOW); GPIO_WRITE_PIN(reg, HIGH);
 #define PULSE_HIGH(reg) GPIO_WRITE_PIN(reg, HIGH); GPIO_WRITE_PIN(reg, LOW);
 #define SWAP(i, j) {typeof(i) t = i; i = j; j = t;}
 
 // Include display
-#include "tftgl_ssd1963.h"
+#include "tftgl_display.h"
+
+// Include touch filter
+#include "tftgl_filter.h"
 
 // Include touchscreen driver
 #include "tftgl_ads7843.h"
 
+// Include touch calibration
+#include "tftgl_calib.h"
+
+// Include emulated display of the simulator
+#ifdef TFTGL_SIM
+#include "tftgl_sim_display.h"
+#endif
+
+// Include tear effect sync and frame pacing
+#include "tftgl_tear.h"
+
+// Include frame diff upload
+#include "tftgl_diff.h"
+
+// Include GPU side RGB-565 packing
+#include "tftgl_pack.h"
+
+// Include damage tracking
+#include "tftgl_dirty.h"
+
+// Include sprites
+#include "tftgl_sprite.h"
+
+// Include video playback
+#include "tftgl_video.h"
+
+// Include background cache and overlay layer
+#include "tftgl_layer.h"
+
 static unsigned char* areaPixels = NULL;
 static TftglEglData eglData;
+static GLenum readbackType = GL_UNSIGNED_BYTE; // Or GL_UNSIGNED_SHORT_5_6_5
+// Every GLES2 implementation must read GL_RGBA but GL_RGB only if it is
+// the implementation read format (it is on VideoCore, it is not on Mesa)
+static GLenum readbackFormat = GL_RGB; // Or GL_RGBA
+static unsigned long lastUploadEnd = 0; // For the render time in stats
+
+// Bytes per pixel of the read buffers, enough for GL_RGBA
+#define TFTGL_READ_BYTES 4
+
+// Picks the config with exactly 5/6/5 bits, eglChooseConfig only
+// guarantees at least that many bits and sorts deeper configs first
+static EGLBoolean tftglChooseConfig565(const EGLint* attribs, EGLConfig* config){
+	EGLConfig configs[64];
+	EGLint i, num, r, g, b;
+	if(!eglChooseConfig(eglData.display, attribs, configs, 64, &num))return EGL_FALSE;
+	for(i = 0; i < num; i++){
+		eglGetConfigAttrib(eglData.display, configs[i], EGL_RED_SIZE, &r);
+		eglGetConfigAttrib(eglData.display, configs[i], EGL_GREEN_SIZE, &g);
+		eglGetConfigAttrib(eglData.display, configs[i], EGL_BLUE_SIZE, &b);
+		if(r == 5 && g == 6 && b == 5){
+			*config = configs[i];
+			return EGL_TRUE;
+		}
+	}
+	return EGL_FALSE;
+}
 
 unsigned int tftglInitEgl(unsigned int flags){
 	const EGLint configAttribs[] = {
 		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
-		EGL_BLUE_SIZE, 8,
-		EGL_GREEN_SIZE, 8,
-		EGL_RED_SIZE, 8,
+		EGL_BLUE_SIZE, (flags & TFTGL_RGB565 ? 5 : 8),
+		EGL_GREEN_SIZE, (flags & TFTGL_RGB565 ? 6 : 8),
+		EGL_RED_SIZE, (flags & TFTGL_RGB565 ? 5 : 8),
 		EGL_ALPHA_SIZE, 0,
 		EGL_DEPTH_SIZE, 0,
 		EGL_STENCIL_SIZE, 1,
@@ -62,7 +165,19 @@ unsigned int tftglInitEgl(unsigned int flags){
 		return TFTGL_ERROR;
 	}
 	
-	if((eglData.display = eglGetDisplay(EGL_DEFAULT_DISPLAY)) == EGL_NO_DISPLAY){
+	eglData.display = EGL_NO_DISPLAY;
+	if(flags & TFTGL_HEADLESS){
+		// Render without any window system or GPU (for example Mesa llvmpipe)
+		const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		TftglGetPlatformDisplay getPlatformDisplay =
+			(TftglGetPlatformDisplay)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if(extensions != NULL && strstr(extensions, "EGL_MESA_platform_surfaceless") != NULL &&
+			getPlatformDisplay != NULL){
+			eglData.display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		}
+	}
+	
+	if(eglData.display == EGL_NO_DISPLAY && (eglData.display = eglGetDisplay(EGL_DEFAULT_DISPLAY)) == EGL_NO_DISPLAY){
 		//fprintf(stderr, "Failed to get EGL display!\n");
 		tftglTerminateEgl();
 		errorCode = TFTGL_NO_DISPLAY;
@@ -77,7 +192,9 @@ unsigned int tftglInitEgl(unsigned int flags){
 	}
 	
 	EGLint numConfigs;
-	if(!eglChooseConfig(eglData.display, configAttribs, &eglData.config, 1, &numConfigs)){
+	if((flags & TFTGL_RGB565) && tftglChooseConfig565(configAttribs, &eglData.config)){
+		// Found RGB-565 config
+	} else if(!eglChooseConfig(eglData.display, configAttribs, &eglData.config, 1, &numConfigs) || numConfigs < 1){
 		//fprintf(stderr, "Failed to get EGL config!\n");
 		tftglTerminateEgl();
 		errorCode = TFTGL_BAD_CONFIG;
@@ -112,6 +229,28 @@ unsigned int tftglInitEgl(unsigned int flags){
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	
+	// Rows of any width must be tightly packed for tftglFillPixels
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	
+	// Read RGB-565 directly if the framebuffer is RGB-565 and GL allows
+	// it, otherwise fall back to RGB-888 and convert on the CPU
+	GLint format, type;
+	glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_FORMAT, &format);
+	glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_TYPE, &type);
+	readbackType = GL_UNSIGNED_BYTE;
+	readbackFormat = GL_RGB;
+	if((flags & TFTGL_RGB565) && format == GL_RGB && type == GL_UNSIGNED_SHORT_5_6_5){
+		readbackType = GL_UNSIGNED_SHORT_5_6_5;
+	} else if(format != GL_RGB || type != GL_UNSIGNED_BYTE){
+		readbackFormat = GL_RGBA;
+	}
+	lastUploadEnd = 0;
+	
+	// Packing only helps when the read is not RGB-565 already
+	if(readbackType != GL_UNSIGNED_SHORT_5_6_5){
+		tftglInitPack(flags);
+	}
+	
 	return TFTGL_OK;
 }
 
@@ -127,27 +266,104 @@ void tftglUploadFbo(){
 	tftglUploadFboArea(0, 0, tftglGetWidth(), tftglGetHeight());
 }
 
-void tftglUploadFboArea(unsigned int x, unsigned int y, unsigned int w, unsigned int h){
-	unsigned int width, height;
-	width = tftglGetWidth();
-	height = tftglGetHeight();
+// Clamps the area to the screen and reads it from the current GL framebuffer
+// into buffer (which must hold the entire screen area). The type is set to
+// the format of the pixels read, the area may grow to fit packed pixels.
+static unsigned int tftglReadFboArea(unsigned int* x, unsigned int y, unsigned int* w, unsigned int* h,
+	unsigned char* buffer, GLenum* type){
+	unsigned long start;
 	
+	if(*x >= LCD_WIDTH || y >= LCD_HEIGHT)return TFTGL_ERROR;
+	if(*w == 0 || *h == 0)return TFTGL_ERROR;
 	
-	
-	if(x >= width || y >= height)return;
-	if(w == 0 || h == 0)return;
+	start = tftglMicros();
+	if(lastUploadEnd != 0){
+		STATS_ADD(renderMicros, start - lastUploadEnd);
+	}
+	STATS_ADD(uploads, 1);
 	
 	// Check area dimensions
-	if(x + w >= LCD_WIDTH){
-		w = LCD_WIDTH - x;
+	if(*x + *w >= LCD_WIDTH){
+		*w = LCD_WIDTH - *x;
+	}
+	if(y + *h >= LCD_HEIGHT){
+		*h = LCD_HEIGHT - y;
+	}
+	
+	if(packEnabled){
+		// Packed texels hold pixel pairs, round the area out to even columns
+		if(*x % 2 != 0){
+			(*x)--;
+			(*w)++;
+		}
+		if(*w % 2 != 0){
+			(*w)++;
+		}
+		if(tftglReadPacked(*x, y, *w, *h, (unsigned short*)buffer) == TFTGL_OK){
+			*type = GL_UNSIGNED_SHORT_5_6_5;
+			STATS_ADD(readMicros, tftglMicros() - start);
+			return TFTGL_OK;
+		}
+	}
+	
+	*type = readbackType;
+	if(readbackFormat == GL_RGBA){
+		// Drop the alpha in place, the buffer ends up as RGB-888
+		unsigned int i, n = *w * *h;
+		glReadPixels(*x, LCD_HEIGHT - y - *h, *w, *h, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
+		for(i = 0; i < n; i++){
+			buffer[i * 3 + 0] = buffer[i * 4 + 0];
+			buffer[i * 3 + 1] = buffer[i * 4 + 1];
+			buffer[i * 3 + 2] = buffer[i * 4 + 2];
+		}
+	} else {
+		glReadPixels(*x, LCD_HEIGHT - y - *h, *w, *h, GL_RGB, readbackType, buffer);
 	}
-	if(y + h >= LCD_HEIGHT){
-		h = LCD_HEIGHT - y;
+	STATS_ADD(readMicros, tftglMicros() - start);
+	return TFTGL_OK;
+}
+
+// Pixels sent so far, zero again after tftglGetStats
+static unsigned long tftglStatsPixels(){
+	unsigned long pixels;
+	pthread_mutex_lock(&statsMutex);
+	pixels = stats.pixels;
+	pthread_mutex_unlock(&statsMutex);
+	return pixels;
+}
+
+// Sends pixels read by tftglReadFboArea to the display
+static void tftglPushFboArea(unsigned int x, unsigned int y, unsigned int w, unsigned int h,
+	const unsigned char* buffer, GLenum type){
+	unsigned long start, pixels, pushed;
+	
+	tftglWaitFrame(x, y, w, h);
+	
+	start = tftglMicros();
+	pixels = tftglStatsPixels();
+	if(frameDiffEnabled){
+		tftglUploadFrameDiff(x, y, w, h, buffer, type);
+	} else if(type == GL_UNSIGNED_SHORT_5_6_5){
+		tftglFillPixels565(x, y, w, h, (const unsigned short*)buffer);
+	} else {
+		tftglFillPixels(x, y, w, h, buffer);
+	}
+	start = tftglMicros() - start;
+	STATS_ADD(pushMicros, start);
+	pushed = tftglStatsPixels();
+	if(pushed > pixels){
+		tftglTearPushed(pushed - pixels, start);
 	}
+	tftglDisplayShow();
+}
+
+void tftglUploadFboArea(unsigned int x, unsigned int y, unsigned int w, unsigned int h){
+	// The display bus can not be shared with the upload thread
+	tftglWaitUpload();
 	
 	if(areaPixels == NULL){
 		// Create pixel buffer that can hold entire screen area
-		areaPixels = (unsigned char*)malloc(width * height * 3);
+		areaPixels = (unsigned char*)malloc(LCD_WIDTH * LCD_HEIGHT * TFTGL_READ_BYTES);
 		if(areaPixels == NULL){
 			errorCode = TFTGL_OUT_OF_MEM;
 			return;
@@ -155,11 +371,166 @@ void tftglUploadFboArea(unsigned int x, unsigned int y, unsigned int w, unsigned
 	}
 	
 	// Get pixels from current GL framebuffer and fill the screen
-	glReadPixels(x, LCD_HEIGHT - y - h, w, h, GL_RGB, GL_UNSIGNED_BYTE, areaPixels);
-	tftglFillPixels(x, y, w, h, areaPixels);
+	GLenum type;
+	if(tftglReadFboArea(&x, y, &w, &h, areaPixels, &type) == TFTGL_OK){
+		tftglPushFboArea(x, y, w, h, areaPixels, type);
+		lastUploadEnd = tftglMicros();
+	}
+}
+
+// Asynchronous upload. The GL thread reads the framebuffer into one of two
+// staging buffers and the upload thread sends it to the display, so the
+// next frame can be rendered while the previous one is being sent.
+typedef struct {
+	unsigned int x, y, w, h;
+	GLenum type;
+	int buffer;
+} TftglUploadJob;
+
+static pthread_t uploadThread;
+static pthread_mutex_t uploadMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t uploadCond = PTHREAD_COND_INITIALIZER;
+static unsigned int uploadThreadRunning = 0;
+static unsigned int uploadQuit = 0;
+static int uploadCpu = -1;
+static unsigned char* uploadPixels[2] = {NULL, NULL};
+static TftglUploadJob uploadQueued = {0, 0, 0, 0, GL_UNSIGNED_BYTE, -1}; // Waiting to be sent
+static int uploadActive = -1; // Buffer being sent by the upload thread
+
+static void tftglPinUploadThread(){
+	cpu_set_t cpus;
+	if(uploadCpu < 0)return;
+	CPU_ZERO(&cpus);
+	CPU_SET(uploadCpu, &cpus);
+	pthread_setaffinity_np(uploadThread, sizeof(cpu_set_t), &cpus);
+}
+
+static void* tftglUploadThreadFunc(void* arg){
+	TftglUploadJob job;
+	(void)arg;
+	
+	pthread_mutex_lock(&uploadMutex);
+	while(1){
+		while(uploadQueued.buffer < 0 && !uploadQuit){
+			pthread_cond_wait(&uploadCond, &uploadMutex);
+		}
+		if(uploadQuit)break;
+		
+		job = uploadQueued;
+		uploadQueued.buffer = -1;
+		uploadActive = job.buffer;
+		pthread_cond_broadcast(&uploadCond);
+		pthread_mutex_unlock(&uploadMutex);
+		
+		tftglPushFboArea(job.x, job.y, job.w, job.h, uploadPixels[job.buffer], job.type);
+		
+		pthread_mutex_lock(&uploadMutex);
+		uploadActive = -1;
+		pthread_cond_broadcast(&uploadCond);
+	}
+	pthread_mutex_unlock(&uploadMutex);
+	return NULL;
+}
+
+static unsigned int tftglStartUploadThread(){
+	unsigned int i;
+	for(i = 0; i < 2; i++){
+		if(uploadPixels[i] == NULL){
+			uploadPixels[i] = (unsigned char*)malloc(LCD_WIDTH * LCD_HEIGHT * TFTGL_READ_BYTES);
+			if(uploadPixels[i] == NULL){
+				errorCode = TFTGL_OUT_OF_MEM;
+				return TFTGL_ERROR;
+			}
+		}
+	}
+	
+	uploadQuit = 0;
+	if(pthread_create(&uploadThread, NULL, tftglUploadThreadFunc, NULL) != 0){
+		errorCode = TFTGL_ERROR;
+		return TFTGL_ERROR;
+	}
+	uploadThreadRunning = 1;
+	tftglPinUploadThread();
+	return TFTGL_OK;
+}
+
+static void tftglStopUploadThread(){
+	unsigned int i;
+	if(uploadThreadRunning){
+		pthread_mutex_lock(&uploadMutex);
+		uploadQuit = 1;
+		pthread_cond_broadcast(&uploadCond);
+		pthread_mutex_unlock(&uploadMutex);
+		pthread_join(uploadThread, NULL);
+		uploadThreadRunning = 0;
+		uploadQueued.buffer = -1;
+		uploadActive = -1;
+	}
+	for(i = 0; i < 2; i++){
+		free(uploadPixels[i]);
+		uploadPixels[i] = NULL;
+	}
+}
+
+unsigned int tftglUploadFboAsync(){
+	return tftglUploadFboAreaAsync(0, 0, tftglGetWidth(), tftglGetHeight());
+}
+
+unsigned int tftglUploadFboAreaAsync(unsigned int x, unsigned int y, unsigned int w, unsigned int h){
+	int buffer;
+	GLenum type;
+	
+	if(!uploadThreadRunning){
+		if(tftglStartUploadThread() != TFTGL_OK)return TFTGL_ERROR;
+	}
+	
+	// Wait until the previously queued frame is taken by the upload thread,
+	// then use the buffer it is not sending
+	pthread_mutex_lock(&uploadMutex);
+	while(uploadQueued.buffer >= 0){
+		pthread_cond_wait(&uploadCond, &uploadMutex);
+	}
+	buffer = (uploadActive == 0 ? 1 : 0);
+	pthread_mutex_unlock(&uploadMutex);
+	
+	if(tftglReadFboArea(&x, y, &w, &h, uploadPixels[buffer], &type) != TFTGL_OK){
+		return TFTGL_ERROR;
+	}
+	
+	pthread_mutex_lock(&uploadMutex);
+	uploadQueued.x = x;
+	uploadQueued.y = y;
+	uploadQueued.w = w;
+	uploadQueued.h = h;
+	uploadQueued.type = type;
+	uploadQueued.buffer = buffer;
+	pthread_cond_broadcast(&uploadCond);
+	pthread_mutex_unlock(&uploadMutex);
+	lastUploadEnd = tftglMicros();
+	return TFTGL_OK;
+}
+
+void tftglWaitUpload(){
+	if(!uploadThreadRunning)return;
+	pthread_mutex_lock(&uploadMutex);
+	while(uploadQueued.buffer >= 0 || uploadActive >= 0){
+		pthread_cond_wait(&uploadCond, &uploadMutex);
+	}
+	pthread_mutex_unlock(&uploadMutex);
+}
+
+void tftglSetUploadCpu(int cpu){
+	uploadCpu = cpu;
+	if(uploadThreadRunning){
+		tftglPinUploadThread();
+	}
 }
 
 void tftglTerminateEgl(){
+	tftglStopUploadThread();
+	tftglTerminatePack();
+	tftglTerminateLayers();
+	
 	eglDestroyContext(eglData.display, eglData.context);
 	eglDestroySurface(eglData.display, eglData.surface);
 	eglTerminate(eglData.display);
@@ -173,6 +544,14 @@ void tftglTerminateEgl(){
 unsigned int tftglInit(unsigned int flags){
 	unsigned int res;
 	
+	if(flags & TFTGL_HEADLESS){
+		// No GPIO, touch or display, uploads only read the framebuffer
+		tftglSetOrientation(flags);
+		res = tftglInitFrameDiff(flags);
+		if(res != TFTGL_OK)return res;
+		return tftglInitEgl(flags);
+	}
+	
 	res = bcm2835_init();
 	if(res != 1){
 		errorCode = TFTGL_GPIO_ERROR;
@@ -187,6 +566,12 @@ unsigned int tftglInit(unsigned int flags){
 	res = tftglInitDisplay(flags);
 	if(res != TFTGL_OK)return res;
 	
+	res = tftglInitTearSync(flags);
+	if(res != TFTGL_OK)return res;
+	
+	res = tftglInitFrameDiff(flags);
+	if(res != TFTGL_OK)return res;
+	
 	res = tftglInitEgl(flags);
 	if(res != TFTGL_OK)return res;
 	
@@ -194,12 +579,28 @@ unsigned int tftglInit(unsigned int flags){
 }
 
 void tftglTerminate(){
-	tftglTerminateTouch();
-	tftglTerminateDisplay();
-	bcm2835_close();
+	tftglStopVideo();
+	tftglWaitUpload();
+	if(gpioData != NULL){
+		tftglTerminateTouch();
+		tftglTerminateTearSync();
+		tftglTerminateDisplay();
+		bcm2835_close();
+		gpioData = NULL;
+	}
+	tftglTerminateFrameDiff();
 	tftglTerminateEgl();
 }
 
+void tftglGetStats(TftglStats* dst){
+	pthread_mutex_lock(&statsMutex);
+	if(dst != NULL){
+		*dst = stats;
+	}
+	memset(&stats, 0, sizeof(TftglStats));
+	pthread_mutex_unlock(&statsMutex);
+}
+
 TftglEglData* tftglGetEglData(){
 	return &eglData;
 }
@@ -228,6 +629,12 @@ const char* tftglGetErrorStr(){
 		case TFTGL_BAD_WIDTH: return "TFTGL_BAD_WIDTH (LCD has invalid width!)";
 		case TFTGL_BAD_HEIGHT: return "TFTGL_BAD_HEIGHT (LCD has invalid height!)";
 		case TFTGL_OUT_OF_MEM: return "TFTGL_OUT_OF_MEM (System is out of memory!)";
+		case TFTGL_NO_TEAR: return "TFTGL_NO_TEAR (No tear effect signal from the LCD!)";
+		case TFTGL_BAD_IMAGE: return "TFTGL_BAD_IMAGE (Could not load image!)";
+		case TFTGL_NO_TOUCH_IRQ: return "TFTGL_NO_TOUCH_IRQ (Could not watch the touch PENIRQ line!)";
+		case TFTGL_BAD_CALIB: return "TFTGL_BAD_CALIB (Invalid touch calibration!)";
+		case TFTGL_FILE_ERROR: return "TFTGL_FILE_ERROR (Could not read or write the file!)";
+		case TFTGL_BAD_SCROLL: return "TFTGL_BAD_SCROLL (Invalid scroll area or orientation!)";
 		default: return "TFTGL_UNKNOWN_ERROR";
 	}
 	return "TFTGL_UNKNOWN_ERROR";
@@ -1,4 +1,17 @@
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
 #define CHIP_SELECT_PIN BCM2835_SPI_CS0
+// PENIRQ of the touch controller for TFTGL_TOUCH_IRQ, GPIO 0 (ID_SD) is
+// the only pin left on the header
+#define TOUCH_IRQ_PIN 0
+#define TOUCH_IRQ_CHIP "/dev/gpiochip0"
 
 #define CMD_START 0x80
 #define CMD_12BIT 0x00
@@ -9,17 +22,49 @@
 #define CMD_POS_Z1 (0x3 << 4)
 #define CMD_POS_Z2 (0x4 << 4)
 #define CMD_PWR 0x3
+#define CMD_PWR_DOWN 0x0 // Power down between conversions, PENIRQ enabled
 
 #define TFTGL_IGNORE_TOUCH (0x10)
-	
-static double remap(double value, double InMin, double InMax, double OutMin, double OutMax) {
-	return (value - InMin)*(OutMax - OutMin) / (InMax - InMin) + OutMin;
-}
 
 static unsigned int minTouchPressure = 100; // Default
-static double calibrationData[4][2] = {
-	{0, 0}, {0, 0}, {0, 0}, {0, 0},
-};
+// Set by tftglSetTouchFilter, the sampler thread reads it with the SPI
+static TftglTouchFilter touchFilter = TOUCH_FILTER_DEFAULT;
+
+// Sampler thread of TFTGL_TOUCH_THREAD and TFTGL_TOUCH_IRQ. It reads the
+// sensor at the report rate, with TFTGL_TOUCH_IRQ only while the pen is
+// down and otherwise it sleeps on the PENIRQ edge. Events go to a single
+// producer single consumer ring drained by tftglGetTouchEvent, the latest
+// reading to a triple buffer read by tftglGetTouchState. Neither side
+// ever waits for the other.
+#define TOUCH_QUEUE 64 // Power of two
+#define TOUCH_RATE 100 // Default readings per second
+
+static pthread_t touchThread;
+static pthread_mutex_t touchSpiMutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int touchSampler = 0; // The thread is running
+static int touchLineFd = -1; // Edge events of PENIRQ, -1 to poll
+static int touchEventFd = -1; // Readable when events were queued
+static int touchStopFd = -1; // Stops the thread
+static atomic_ulong touchInterval = 1000000 / TOUCH_RATE; // us
+
+// The thread only moves the head, the app only moves the tail
+static TftglTouchEvent touchQueue[TOUCH_QUEUE];
+static atomic_uint touchHead = 0;
+static atomic_uint touchTail = 0;
+
+// Triple buffer of the latest reading. The thread writes its back slot
+// and swaps it with the middle one, the app swaps the middle one with its
+// front slot if it is newer. TOUCH_STATE_FRESH marks a new middle slot.
+#define TOUCH_STATE_FRESH 4
+static TftglTouchState touchStates[3];
+static unsigned int touchStateBack = 0;
+static atomic_uint touchStateMiddle = 1;
+static unsigned int touchStateFront = 2;
+
+static unsigned int tftglStartTouchSampler(unsigned int irq);
+static void tftglStopTouchSampler();
+static void tftglBuildTouchBatches(unsigned int sampler);
+static void tftglTouchMap(unsigned int rawx, unsigned int rawy, unsigned int* x, unsigned int* y);
 
 unsigned int tftglInitTouch(unsigned int flags) {
 	if(flags & TFTGL_IGNORE_TOUCH){
@@ -30,6 +75,20 @@ unsigned int tftglInitTouch(unsigned int flags) {
 		errorCode = TFTGL_SPI_ERROR;
 		return TFTGL_ERROR;
     }
+
+	// Set once, nothing else in the library uses the SPI.
+	// 2048 is about 122 Khz
+	// Anything higher may not be correct reading
+	bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_4096);
+	bcm2835_spi_chipSelect(CHIP_SELECT_PIN);
+	tftglBuildTouchBatches(flags & (TFTGL_TOUCH_IRQ | TFTGL_TOUCH_THREAD));
+
+	if(flags & (TFTGL_TOUCH_IRQ | TFTGL_TOUCH_THREAD)){
+		if(tftglStartTouchSampler(flags & TFTGL_TOUCH_IRQ) != TFTGL_OK){
+			bcm2835_spi_end();
+			return TFTGL_ERROR;
+		}
+	}
 	
 	//bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);      // The default
     //bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);                   // The default
@@ -40,75 +99,156 @@ unsigned int tftglInitTouch(unsigned int flags) {
 }
 
 void tftglTerminateTouch() {
+	tftglStopTouchSampler();
 	bcm2835_spi_end();
 }
 
-static unsigned int tftglGetTouchRawData16(unsigned int target, unsigned int c){
-	static unsigned char out[3];
-	static unsigned char buf[3];
-	unsigned int i, ret;
-	buf[0] = (CMD_START | CMD_12BIT | CMD_DFR | target | CMD_PWR);
-	
-	ret = 0;
-	for(i = 0; i < c; i++){
-		bcm2835_spi_transfernb(buf, out, 3);
-		ret += (out[1] << 8 | out[2])>>3;
+// Conversions sent as a single SPI transfer. In the 16 clocks per
+// conversion mode the control byte of the next conversion goes out while
+// the last bits of the previous result come in, so a conversion costs two
+// bytes instead of three and a reading one transfer instead of one per
+// sample. The result of conversion i is in the bytes 2i+1 and 2i+2.
+#define TOUCH_MAX_CONVERSIONS (TOUCH_MAX_SAMPLES * 2 + 2)
+
+typedef struct {
+	unsigned char tx[TOUCH_MAX_CONVERSIONS * 2 + 1];
+	unsigned int count;
+} TftglTouchBatch;
+
+// Built at init and by tftglSetTouchFilter, see tftglBuildTouchBatches.
+// N is the samples of the filter.
+static TftglTouchBatch touchBatchRaw; // 8 Z1, 8 X, 8 Y
+static TftglTouchBatch touchBatchPress; // 1 Z1
+static TftglTouchBatch touchBatchPos; // N X, N Y, Z1, Z2
+static TftglTouchBatch touchBatchIdle; // 1 Z1, 1 Z1 powering down
+static TftglTouchBatch touchBatchSample; // N X, N Y, Z1, Z2 powering down
+static unsigned int touchBatchSampler = 0;
+
+static void tftglTouchBatchAdd(TftglTouchBatch* batch, unsigned int control, unsigned int n){
+	while(n-- > 0){
+		batch->tx[batch->count * 2] = CMD_START | CMD_12BIT | CMD_DFR | control;
+		batch->tx[batch->count * 2 + 1] = 0;
+		batch->count++;
 	}
-	return (ret / c);
+	batch->tx[batch->count * 2] = 0;
 }
 
-static unsigned int tftglGetTouchRawData8(unsigned int target, unsigned int c){
-	static unsigned char out[2];
-	static unsigned char buf[2];
-	unsigned int i, ret;
-	buf[0] = (CMD_START | CMD_8BIT | CMD_DFR | target | CMD_PWR);
-	
-	ret = 0;
-	for(i = 0; i < c; i++){
-		bcm2835_spi_transfernb(buf, out, 2);
-		ret += out[1];
+static void tftglTouchBatchRun(const TftglTouchBatch* batch, unsigned int* results){
+	unsigned char rx[TOUCH_MAX_CONVERSIONS * 2 + 1];
+	unsigned long start = tftglMicros();
+	unsigned int i;
+
+	bcm2835_spi_transfernb((char*)batch->tx, (char*)rx, batch->count * 2 + 1);
+	for(i = 0; i < batch->count; i++){
+		results[i] = (rx[i * 2 + 1] << 8 | rx[i * 2 + 2]) >> 3;
 	}
-	return (ret / c);
+	STATS_ADD(touchConversions, batch->count);
+	STATS_ADD(touchMicros, tftglMicros() - start);
+}
+
+static void tftglBuildTouchBatches(unsigned int sampler){
+	unsigned int n = touchFilter.samples;
+	touchBatchSampler = sampler;
+
+	memset(&touchBatchRaw, 0, sizeof(TftglTouchBatch));
+	memset(&touchBatchPress, 0, sizeof(TftglTouchBatch));
+	memset(&touchBatchPos, 0, sizeof(TftglTouchBatch));
+	memset(&touchBatchIdle, 0, sizeof(TftglTouchBatch));
+	memset(&touchBatchSample, 0, sizeof(TftglTouchBatch));
+
+	tftglTouchBatchAdd(&touchBatchRaw, CMD_POS_Z1 | CMD_PWR, 8);
+	tftglTouchBatchAdd(&touchBatchRaw, CMD_POS_X | CMD_PWR, 8);
+	tftglTouchBatchAdd(&touchBatchRaw, CMD_POS_Y | CMD_PWR, 8);
+	// Enable PENIRQ again after the reading, for the sampler thread
+	if(sampler)tftglTouchBatchAdd(&touchBatchRaw, CMD_POS_Z1 | CMD_PWR_DOWN, 1);
+
+	tftglTouchBatchAdd(&touchBatchPress, CMD_POS_Z1 | CMD_PWR, 1);
+
+	tftglTouchBatchAdd(&touchBatchPos, CMD_POS_X | CMD_PWR, n);
+	tftglTouchBatchAdd(&touchBatchPos, CMD_POS_Y | CMD_PWR, n);
+	tftglTouchBatchAdd(&touchBatchPos, CMD_POS_Z1 | CMD_PWR, 1);
+	tftglTouchBatchAdd(&touchBatchPos, CMD_POS_Z2 | CMD_PWR, 1);
+
+	tftglTouchBatchAdd(&touchBatchIdle, CMD_POS_Z1 | CMD_PWR, 1);
+	tftglTouchBatchAdd(&touchBatchIdle, CMD_POS_Z1 | CMD_PWR_DOWN, 1);
+
+	tftglTouchBatchAdd(&touchBatchSample, CMD_POS_X | CMD_PWR, n);
+	tftglTouchBatchAdd(&touchBatchSample, CMD_POS_Y | CMD_PWR, n);
+	tftglTouchBatchAdd(&touchBatchSample, CMD_POS_Z1 | CMD_PWR, 1);
+	tftglTouchBatchAdd(&touchBatchSample, CMD_POS_Z2 | CMD_PWR_DOWN, 1);
 }
 
 void tftglGetTouchRaw(unsigned int* x, unsigned int* y, unsigned int* z){
-	// 2048 is about 122 Khz
-	// Anything higher may not be correct reading
-	bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_4096);
-	bcm2835_spi_chipSelect(CHIP_SELECT_PIN);
-	
-	if(z != NULL)*z = tftglGetTouchRawData16(CMD_POS_Z1, 8);
-	if(x != NULL)*x = tftglGetTouchRawData16(CMD_POS_X, 8);
-	if(y != NULL)*y = tftglGetTouchRawData16(CMD_POS_Y, 8);
+	unsigned int results[TOUCH_MAX_CONVERSIONS];
+	unsigned int combine, spread;
+
+	// The sampler thread shares the SPI
+	pthread_mutex_lock(&touchSpiMutex);
+	tftglTouchBatchRun(&touchBatchRaw, results);
+	combine = touchFilter.combine;
+	pthread_mutex_unlock(&touchSpiMutex);
+
+	if(z != NULL)*z = tftglTouchCombine(&results[0], 8, combine, &spread);
+	if(x != NULL)*x = tftglTouchCombine(&results[8], 8, combine, &spread);
+	if(y != NULL)*y = tftglTouchCombine(&results[16], 8, combine, &spread);
 }
 
+void tftglGetTouchSamples(unsigned int* samples, unsigned int n){
+	TftglTouchBatch batch;
+
+	if(n < 1)n = 1;
+	if(n > TOUCH_MAX_SAMPLES)n = TOUCH_MAX_SAMPLES;
+	memset(&batch, 0, sizeof(batch));
+	tftglTouchBatchAdd(&batch, CMD_POS_X | CMD_PWR, n);
+	tftglTouchBatchAdd(&batch, CMD_POS_Y | CMD_PWR, n);
+	tftglTouchBatchAdd(&batch, CMD_POS_Z1 | CMD_PWR, 1);
+	tftglTouchBatchAdd(&batch, CMD_POS_Z2 | (touchBatchSampler ? CMD_PWR_DOWN : CMD_PWR), 1);
+
+	pthread_mutex_lock(&touchSpiMutex);
+	tftglTouchBatchRun(&batch, samples);
+	pthread_mutex_unlock(&touchSpiMutex);
+}
+
+// Stroke of tftglGetTouch without the sampler thread, the last position
+// is kept for readings skipped by the filter
+static TftglTouchEuro touchPollEuro;
+static unsigned int touchPollDown = 0;
+static unsigned int touchPollX, touchPollY;
+
 unsigned int tftglGetTouch(unsigned int* x, unsigned int* y){
-	unsigned int i, press;
-	// 2048 is about 122 Khz
-	// Anything higher may not be correct reading
-	bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_4096);
-	bcm2835_spi_chipSelect(CHIP_SELECT_PIN);
-	
-	press = tftglGetTouchRawData16(CMD_POS_Z1, 1);
-	if(press > minTouchPressure){
+	unsigned int results[TOUCH_MAX_CONVERSIONS];
+	unsigned int rawX, rawY;
+
+	// The sampler thread has the last reading already
+	if(touchSampler){
+		TftglTouchState state;
+		tftglGetTouchState(&state);
+		if(x != NULL)*x = state.x;
+		if(y != NULL)*y = state.y;
+		return state.down ? TFTGL_GOT_TOUCH : TFTGL_NO_TOUCH;
+	}
+
+	tftglTouchBatchRun(&touchBatchPress, results);
+	if(results[0] > minTouchPressure){
 		// Calculate only if either X or Y are not null!
-		if(x != NULL){
-			double rawx = (double)tftglGetTouchRawData16(CMD_POS_X, 8);
-			double weight = remap(rawx, calibrationData[0][0], calibrationData[1][0], 0.0, 1.0);
-			
-			//printf("Remapped X: %f weight: %f\n", rawx, weight);
-			*x = (unsigned int)remap(weight, 0.0, 1.0, calibrationData[0][1], calibrationData[1][1]);
-		}
-		if(y != NULL){
-			
-			double rawy = (double)tftglGetTouchRawData16(CMD_POS_Y, 8);
-			double weight = remap(rawy, calibrationData[2][0], calibrationData[3][0], 0.0, 1.0);
-			
-			//printf("Remapped Y: %f weight: %f\n", rawy, weight);
-			*y = (unsigned int)remap(weight, 0.0, 1.0, calibrationData[2][1], calibrationData[3][1]);
+		if(x != NULL || y != NULL){
+			tftglTouchBatchRun(&touchBatchPos, results);
+			if(results[touchFilter.samples * 2] > minTouchPressure &&
+				tftglTouchFilterReading(&touchFilter, &touchPollEuro, results, &rawX, &rawY,
+				tftglMicros()) == TOUCH_PRESSED){
+				touchPollDown = 1;
+				touchPollX = rawX;
+				touchPollY = rawY;
+			} else if(!touchPollDown){
+				// Nothing good yet, the pen is only landing
+				return TFTGL_NO_TOUCH;
+			}
+			tftglTouchMap(touchPollX, touchPollY, x, y);
 		}
 		return TFTGL_GOT_TOUCH;
 	}
+	touchPollDown = 0;
+	tftglTouchEuroReset(&touchPollEuro);
 	return TFTGL_NO_TOUCH;
 }
 
@@ -116,12 +256,288 @@ void tftglSetTouchSensitivity(unsigned int val){
 	minTouchPressure = val;
 }
 
-void tftglSetTouchCalibration(unsigned int which, unsigned int val, unsigned int pos){
-	switch(which){
-		case TFTGL_CALIB_MIN_X: calibrationData[0][0] = (double)val; calibrationData[0][1] = (double)pos; break;
-		case TFTGL_CALIB_MAX_X: calibrationData[1][0] = (double)val; calibrationData[1][1] = (double)pos; break;
-		case TFTGL_CALIB_MIN_Y: calibrationData[2][0] = (double)val; calibrationData[2][1] = (double)pos; break;
-		case TFTGL_CALIB_MAX_Y: calibrationData[3][0] = (double)val; calibrationData[3][1] = (double)pos; break;
-		default: break;
+void tftglSetTouchFilter(const TftglTouchFilter* filter){
+	TftglTouchFilter f = *filter;
+
+	if(f.samples < 1)f.samples = 1;
+	if(f.samples > TOUCH_MAX_SAMPLES)f.samples = TOUCH_MAX_SAMPLES;
+	if(f.combine > TFTGL_TOUCH_TRIMMED)f.combine = TFTGL_TOUCH_MEAN;
+	if(f.minCutoff < 0)f.minCutoff = 0;
+
+	// Takes effect from the next reading of the sampler thread
+	pthread_mutex_lock(&touchSpiMutex);
+	touchFilter = f;
+	tftglBuildTouchBatches(touchBatchSampler);
+	pthread_mutex_unlock(&touchSpiMutex);
+}
+
+void tftglGetTouchFilter(TftglTouchFilter* filter){
+	pthread_mutex_lock(&touchSpiMutex);
+	*filter = touchFilter;
+	pthread_mutex_unlock(&touchSpiMutex);
+}
+
+// Opens the edge events of the PENIRQ line, falling edges only as the line
+// goes low on touch. Returns the file descriptor or -1.
+static int tftglTouchOpenLine(){
+#ifdef TFTGL_SIM
+	return tftglSimOpenLineEvent(TOUCH_IRQ_PIN);
+#else
+	struct gpioevent_request req;
+	int chip = open(TOUCH_IRQ_CHIP, O_RDONLY | O_CLOEXEC);
+	if(chip < 0)return -1;
+
+	// PENIRQ is open drain
+	bcm2835_gpio_set_pud(TOUCH_IRQ_PIN, BCM2835_GPIO_PUD_UP);
+
+	memset(&req, 0, sizeof(req));
+	req.lineoffset = TOUCH_IRQ_PIN;
+	req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+	req.eventflags = GPIOEVENT_REQUEST_FALLING_EDGE;
+	strcpy(req.consumer_label, "tftgl-penirq");
+	if(ioctl(chip, GPIO_GET_LINEEVENT_IOCTL, &req) < 0){
+		close(chip);
+		return -1;
+	}
+	close(chip);
+	fcntl(req.fd, F_SETFL, fcntl(req.fd, F_GETFL) | O_NONBLOCK);
+	return req.fd;
+#endif
+}
+
+static void tftglTouchDrainLine(){
+	struct gpioevent_data edge;
+	while(read(touchLineFd, &edge, sizeof(edge)) == sizeof(edge));
+}
+
+// Returns 1 if PENIRQ is high, the pen is up. Errors count as low so the
+// sampler keeps reading on its timer.
+static unsigned int tftglTouchLineHigh(){
+#ifdef TFTGL_SIM
+	return tftglSimReadLine(touchLineFd);
+#else
+	struct gpiohandle_data data;
+	memset(&data, 0, sizeof(data));
+	if(ioctl(touchLineFd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) < 0)return 0;
+	return data.values[0] != 0;
+#endif
+}
+
+// Queues an event, wakes up the app. Moves need room for the up event as
+// well, and a stroke that did not fit is dropped up to its up event, so
+// the app always sees complete down, move, up sequences.
+static unsigned int touchStrokeDropped = 0;
+
+static void tftglTouchPush(unsigned int type, unsigned int x, unsigned int y, unsigned long micros){
+	unsigned int head = atomic_load_explicit(&touchHead, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&touchTail, memory_order_acquire);
+	unsigned int room = TOUCH_QUEUE - (head - tail);
+	uint64_t one = 1;
+
+	if(type == TFTGL_TOUCH_DOWN)touchStrokeDropped = (room < 2);
+	if(touchStrokeDropped || (type == TFTGL_TOUCH_MOVE && room < 2))return;
+
+	TftglTouchEvent* ev = &touchQueue[head % TOUCH_QUEUE];
+	ev->type = type;
+	ev->x = x;
+	ev->y = y;
+	ev->micros = micros;
+	atomic_store_explicit(&touchHead, head + 1, memory_order_release);
+
+	if(write(touchEventFd, &one, sizeof(one)) < 0){
+		// Can not fail, the counter is read by the app
+	}
+}
+
+static void tftglTouchPublish(unsigned int down, unsigned int x, unsigned int y, unsigned long micros){
+	TftglTouchState* state = &touchStates[touchStateBack];
+	state->down = down;
+	state->x = x;
+	state->y = y;
+	state->micros = micros;
+	touchStateBack = atomic_exchange_explicit(&touchStateMiddle,
+		touchStateBack | TOUCH_STATE_FRESH, memory_order_acq_rel) & ~TOUCH_STATE_FRESH;
+}
+
+// Reads the pen and, only if it is down, the position and the pressure
+// after it, then runs the reading through the filter. The converter is
+// powered down afterwards so PENIRQ works again.
+static unsigned int tftglTouchSample(TftglTouchEuro* euro, unsigned int* x, unsigned int* y){
+	unsigned int results[TOUCH_MAX_CONVERSIONS];
+	TftglTouchFilter filter;
+	unsigned int rawX, rawY;
+
+	pthread_mutex_lock(&touchSpiMutex);
+	tftglTouchBatchRun(&touchBatchIdle, results);
+	if(results[0] <= minTouchPressure){
+		pthread_mutex_unlock(&touchSpiMutex);
+		return TOUCH_UP;
+	}
+	tftglTouchBatchRun(&touchBatchSample, results);
+	filter = touchFilter;
+	pthread_mutex_unlock(&touchSpiMutex);
+
+	if(results[filter.samples * 2] <= minTouchPressure)return TOUCH_UNSTABLE;
+	if(tftglTouchFilterReading(&filter, euro, results, &rawX, &rawY, tftglMicros()) != TOUCH_PRESSED){
+		return TOUCH_UNSTABLE;
+	}
+	tftglTouchMap(rawX, rawY, x, y);
+	return TOUCH_PRESSED;
+}
+
+static void* tftglTouchRun(void* arg){
+	struct pollfd fds[2];
+	unsigned int x = 0, y = 0, down = 0, lastX = 0, lastY = 0;
+	unsigned long next = tftglMicros();
+	TftglTouchEuro euro;
+	(void)arg;
+
+	tftglTouchEuroReset(&euro);
+
+	fds[0].fd = touchStopFd;
+	fds[0].events = POLLIN;
+	fds[1].fd = touchLineFd;
+	fds[1].events = POLLIN;
+
+	for(;;){
+		unsigned int result;
+		unsigned long now;
+
+		result = tftglTouchSample(&euro, &x, &y);
+		now = tftglMicros();
+		if(result == TOUCH_PRESSED){
+			if(!down){
+				tftglTouchPush(TFTGL_TOUCH_DOWN, x, y, now);
+			} else if(x != lastX || y != lastY){
+				tftglTouchPush(TFTGL_TOUCH_MOVE, x, y, now);
+			}
+			down = 1;
+			lastX = x;
+			lastY = y;
+			tftglTouchPublish(1, x, y, now);
+		} else if(result == TOUCH_UP && down){
+			tftglTouchPush(TFTGL_TOUCH_UP, lastX, lastY, now);
+			down = 0;
+			tftglTouchEuroReset(&euro);
+			tftglTouchPublish(0, lastX, lastY, now);
+		}
+
+		// PENIRQ toggles during the conversions above, forget those edges.
+		// A touch from here on leaves a new edge, an earlier one keeps the
+		// line low.
+		if(touchLineFd >= 0)tftglTouchDrainLine();
+
+		if(result == TOUCH_UP && touchLineFd >= 0 && tftglTouchLineHigh()){
+			// Sleep until the pen goes down
+			if(poll(fds, 2, -1) < 0 && errno != EINTR)break;
+			if(fds[0].revents)break;
+			next = tftglMicros();
+		} else {
+			// Keep the rate, without catching up on a late reading
+			struct timespec ts;
+			unsigned long interval = atomic_load_explicit(&touchInterval, memory_order_relaxed);
+			next += interval;
+			now = tftglMicros();
+			if(next < now)next = now;
+			ts.tv_sec = (next - now) / 1000000;
+			ts.tv_nsec = (next - now) % 1000000 * 1000;
+			if(ppoll(fds, 1, &ts, NULL) != 0 && fds[0].revents)break;
+		}
+	}
+	return NULL;
+}
+
+static unsigned int tftglStartTouchSampler(unsigned int irq){
+	atomic_store(&touchHead, 0);
+	atomic_store(&touchTail, 0);
+	memset(touchStates, 0, sizeof(touchStates));
+	touchStateBack = 0;
+	atomic_store(&touchStateMiddle, 1);
+	touchStateFront = 2;
+	touchStrokeDropped = 0;
+
+	if(irq){
+		touchLineFd = tftglTouchOpenLine();
+		if(touchLineFd < 0){
+			errorCode = TFTGL_NO_TOUCH_IRQ;
+			return TFTGL_ERROR;
+		}
+	}
+	touchEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	touchStopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(touchEventFd < 0 || touchStopFd < 0 ||
+		pthread_create(&touchThread, NULL, tftglTouchRun, NULL) != 0){
+		tftglStopTouchSampler();
+		errorCode = TFTGL_ERROR;
+		return TFTGL_ERROR;
+	}
+	touchSampler = 1;
+	return TFTGL_OK;
+}
+
+static void tftglStopTouchSampler(){
+	uint64_t one = 1;
+
+	if(touchSampler){
+		if(write(touchStopFd, &one, sizeof(one)) < 0){
+			// Can not fail, the counter is fresh
+		}
+		pthread_join(touchThread, NULL);
+		touchSampler = 0;
+	}
+	if(touchLineFd >= 0)close(touchLineFd);
+	if(touchEventFd >= 0)close(touchEventFd);
+	if(touchStopFd >= 0)close(touchStopFd);
+	touchLineFd = touchEventFd = touchStopFd = -1;
+}
+
+void tftglSetTouchRate(unsigned int rate){
+	if(rate == 0)rate = TOUCH_RATE;
+	atomic_store_explicit(&touchInterval, 1000000 / rate, memory_order_relaxed);
+}
+
+int tftglGetTouchFd(){
+	return touchEventFd;
+}
+
+static unsigned int tftglTouchPop(TftglTouchEvent* event){
+	unsigned int tail = atomic_load_explicit(&touchTail, memory_order_relaxed);
+	if(tail == atomic_load_explicit(&touchHead, memory_order_acquire))return 0;
+	if(event != NULL)*event = touchQueue[tail % TOUCH_QUEUE];
+	atomic_store_explicit(&touchTail, tail + 1, memory_order_release);
+	return 1;
+}
+
+unsigned int tftglGetTouchEvent(TftglTouchEvent* event, int timeout){
+	struct pollfd fds;
+	uint64_t count;
+
+	if(!touchSampler)return TFTGL_NO_TOUCH;
+
+	fds.fd = touchEventFd;
+	fds.events = POLLIN;
+	for(;;){
+		if(tftglTouchPop(event))return TFTGL_GOT_TOUCH;
+
+		// Clear the wakeups, an event queued meanwhile is seen below or
+		// writes the eventfd again
+		if(read(touchEventFd, &count, sizeof(count)) < 0){
+			// Already zero
+		}
+		if(tftglTouchPop(event))return TFTGL_GOT_TOUCH;
+
+		if(timeout == 0)return TFTGL_NO_TOUCH;
+		if(poll(&fds, 1, timeout) == 0)return TFTGL_NO_TOUCH;
+		// A full wait once, then only what is queued
+		if(timeout > 0)timeout = 0;
 	}
-}
\ No newline at end of file
+}
+
+void tftglGetTouchState(TftglTouchState* state){
+	// Take the middle slot if the thread left a newer one there
+	if(atomic_load_explicit(&touchStateMiddle, memory_order_relaxed) & TOUCH_STATE_FRESH){
+		touchStateFront = atomic_exchange_explicit(&touchStateMiddle, touchStateFront,
+			memory_order_acq_rel) & ~TOUCH_STATE_FRESH;
+	}
+	*state = touchStates[touchStateFront];
+}
@@ -0,0 +1,52 @@
+// Data bus of the 8080 interface. Needs LCD_D0 to LCD_D15,
+// LCD_DATA_CONSECUTIVE and GPIO_WRITE_REG, bench/bustables.c includes it
+// with its own wiring to check the tables.
+
+// GPSET0 masks for the low and high byte of a 16-bit bus value.
+// The GPCLR0 mask is the remaining data pins, see LCD_BUS_WRITE.
+static const unsigned char busPins[16] = {
+	LCD_D0, LCD_D1, LCD_D2, LCD_D3, LCD_D4, LCD_D5, LCD_D6, LCD_D7,
+	LCD_D8, LCD_D9, LCD_D10, LCD_D11, LCD_D12, LCD_D13, LCD_D14, LCD_D15
+};
+static uint32_t busSetLo[256];
+static uint32_t busSetHi[256];
+static uint32_t busMaskLo = 0; // D0 to D7
+static uint32_t busMask = 0; // D0 to D15
+
+// Use LCD_BUS_WRITE(rgb) to put a 16-bit value on D0 to D15
+// Use LCD_BUS_INVALID as a previous bus value that never matches a pixel
+// Use LCD_BUS_WRITE8(data) to put a 8-bit value on D0 to D7
+#define LCD_BUS_INVALID (0xFFFFFFFF)
+#if defined(LCD_DATA_CONSECUTIVE) && LCD_DATA_CONSECUTIVE == 1
+#define LCD_BUS_WRITE(rgb) { \
+	GPIO_WRITE_REG(GPIO_GPFSET0, ((rgb) << LCD_D0)); \
+	GPIO_WRITE_REG(GPIO_GPFCLR0, ((~(rgb) & 0xFFFF) << LCD_D0)); }
+#define LCD_BUS_WRITE8(data) { \
+	GPIO_WRITE_REG(GPIO_GPFSET0, ((data) << LCD_D0)); \
+	GPIO_WRITE_REG(GPIO_GPFCLR0, ((~(data) & 0xFF) << LCD_D0)); }
+#else
+#define LCD_BUS_WRITE(rgb) { \
+	uint32_t busSet = busSetLo[(rgb) & 0xFF] | busSetHi[((rgb) >> 8) & 0xFF]; \
+	GPIO_WRITE_REG(GPIO_GPFSET0, busSet); \
+	GPIO_WRITE_REG(GPIO_GPFCLR0, busMask ^ busSet); }
+#define LCD_BUS_WRITE8(data) { \
+	uint32_t busSet = busSetLo[(data) & 0xFF]; \
+	GPIO_WRITE_REG(GPIO_GPFSET0, busSet); \
+	GPIO_WRITE_REG(GPIO_GPFCLR0, busMaskLo ^ busSet); }
+#endif
+
+static void tftglInitBusTables(){
+	unsigned int i, bit;
+	for(i = 0; i < 256; i++){
+		busSetLo[i] = 0;
+		busSetHi[i] = 0;
+		for(bit = 0; bit < 8; bit++){
+			if(i & (1 << bit)){
+				busSetLo[i] |= (1 << busPins[bit]);
+				busSetHi[i] |= (1 << busPins[bit + 8]);
+			}
+		}
+	}
+	busMaskLo = busSetLo[0xFF];
+	busMask = busSetLo[0xFF] | busSetHi[0xFF];
+}
@@ -0,0 +1,218 @@
+// Affine touch calibration. Both screen coordinates depend on both raw
+// coordinates, which also corrects panels glued on rotated or skewed:
+//   x = (a * rawX + b * rawY + c) / 65536
+//   y = (d * rawX + e * rawY + f) / 65536
+// The matrix is solved in floating point once and applied in 16.16 fixed
+// point to every reading.
+#define TOUCH_CALIB_SHIFT 16
+#define TOUCH_CALIB_ONE (1 << TOUCH_CALIB_SHIFT)
+#define TOUCH_CALIB_MAGIC "tftgl-calib"
+#define TOUCH_CALIB_VERSION 1
+
+// The sampler thread maps readings while the app may set a new matrix
+static pthread_mutex_t touchCalibMutex = PTHREAD_MUTEX_INITIALIZER;
+static TftglTouchCalibration touchCalib = {0, 0, 0, 0, 0, 0};
+
+// Points of tftglSetTouchCalibration, raw value and pixel position
+static unsigned int calibrationData[4][2] = {
+	{0, 0}, {0, 0}, {0, 0}, {0, 0},
+};
+
+static unsigned int tftglTouchAxis(long long value, unsigned int size){
+	value = (value + TOUCH_CALIB_ONE / 2) >> TOUCH_CALIB_SHIFT;
+	if(value < 0)return 0;
+	if(value >= size)return size - 1;
+	return (unsigned int)value;
+}
+
+static void tftglTouchMap(unsigned int rawx, unsigned int rawy, unsigned int* x, unsigned int* y){
+	TftglTouchCalibration m;
+
+	pthread_mutex_lock(&touchCalibMutex);
+	m = touchCalib;
+	pthread_mutex_unlock(&touchCalibMutex);
+
+	if(x != NULL)*x = tftglTouchAxis((long long)m.a * rawx + (long long)m.b * rawy + m.c, LCD_WIDTH);
+	if(y != NULL)*y = tftglTouchAxis((long long)m.d * rawx + (long long)m.e * rawy + m.f, LCD_HEIGHT);
+}
+
+// Converts to 16.16, returns zero if it does not fit
+static unsigned int tftglTouchFixed(double value, int* fixed){
+	value *= TOUCH_CALIB_ONE;
+	if(value != value || value >= 2147483647.0 || value <= -2147483647.0)return 0;
+	*fixed = (int)(value < 0 ? value - 0.5 : value + 0.5);
+	return 1;
+}
+
+void tftglSetTouchMatrix(const TftglTouchCalibration* calib){
+	pthread_mutex_lock(&touchCalibMutex);
+	touchCalib = *calib;
+	pthread_mutex_unlock(&touchCalibMutex);
+}
+
+void tftglGetTouchMatrix(TftglTouchCalibration* calib){
+	pthread_mutex_lock(&touchCalibMutex);
+	*calib = touchCalib;
+	pthread_mutex_unlock(&touchCalibMutex);
+}
+
+// Least squares fit of one screen axis, exact for three points. Raw
+// coordinates are taken relative to their mean, which splits the normal
+// equations into a 2x2 system and keeps them well conditioned.
+static unsigned int tftglSolveTouchAxis(const TftglCalibrationPoint* points, unsigned int count,
+	unsigned int axis, int* a, int* b, int* c){
+	double mx = 0, my = 0, ms = 0;
+	double suu = 0, svv = 0, suv = 0, sus = 0, svs = 0;
+	double det, ka, kb;
+	unsigned int i;
+
+	for(i = 0; i < count; i++){
+		mx += points[i].rawX;
+		my += points[i].rawY;
+		ms += axis ? points[i].y : points[i].x;
+	}
+	mx /= count;
+	my /= count;
+	ms /= count;
+
+	for(i = 0; i < count; i++){
+		double u = points[i].rawX - mx;
+		double v = points[i].rawY - my;
+		double s = (axis ? points[i].y : points[i].x) - ms;
+		suu += u * u;
+		svv += v * v;
+		suv += u * v;
+		sus += u * s;
+		svs += v * s;
+	}
+
+	// Points on a line (or the same point touched twice) leave one
+	// direction unknown
+	det = suu * svv - suv * suv;
+	if(suu <= 0 || svv <= 0 || det <= suu * svv * 1e-3)return 0;
+
+	ka = (sus * svv - svs * suv) / det;
+	kb = (svs * suu - sus * suv) / det;
+	return tftglTouchFixed(ka, a) && tftglTouchFixed(kb, b) &&
+		tftglTouchFixed(ms - ka * mx - kb * my, c);
+}
+
+unsigned int tftglSolveTouchCalibration(const TftglCalibrationPoint* points, unsigned int count,
+	TftglTouchCalibration* calib){
+	TftglTouchCalibration m;
+
+	if(count < 3 || !tftglSolveTouchAxis(points, count, 0, &m.a, &m.b, &m.c) ||
+		!tftglSolveTouchAxis(points, count, 1, &m.d, &m.e, &m.f)){
+		errorCode = TFTGL_BAD_CALIB;
+		return TFTGL_ERROR;
+	}
+	*calib = m;
+	return TFTGL_OK;
+}
+
+unsigned int tftglCalibrateTouch(const TftglCalibrationPoint* points, unsigned int count){
+	TftglTouchCalibration m;
+	if(tftglSolveTouchCalibration(points, count, &m) != TFTGL_OK)return TFTGL_ERROR;
+	tftglSetTouchMatrix(&m);
+	return TFTGL_OK;
+}
+
+void tftglSetTouchCalibration(unsigned int which, unsigned int val, unsigned int pos){
+	TftglTouchCalibration m;
+	unsigned int axis, min;
+	double scale;
+	int k, offset;
+
+	if(which > TFTGL_CALIB_MAX_Y)return;
+	calibrationData[which][0] = val;
+	calibrationData[which][1] = pos;
+
+	// The same matrix without the cross terms, an axis stays unmapped
+	// until both of its points are set
+	axis = which >= TFTGL_CALIB_MIN_Y;
+	min = axis ? TFTGL_CALIB_MIN_Y : TFTGL_CALIB_MIN_X;
+	if(calibrationData[min][0] == calibrationData[min + 1][0])return;
+	scale = ((double)calibrationData[min + 1][1] - calibrationData[min][1]) /
+		((double)calibrationData[min + 1][0] - calibrationData[min][0]);
+	if(!tftglTouchFixed(scale, &k) ||
+		!tftglTouchFixed(calibrationData[min][1] - scale * calibrationData[min][0], &offset))return;
+
+	tftglGetTouchMatrix(&m);
+	if(axis){
+		m.d = 0;
+		m.e = k;
+		m.f = offset;
+	} else {
+		m.a = k;
+		m.b = 0;
+		m.c = offset;
+	}
+	tftglSetTouchMatrix(&m);
+}
+
+// Profile file, one line each:
+//   tftgl-calib 1
+//   size <width> <height>
+//   matrix <a> <b> <c> <d> <e> <f>
+//   sensitivity <pressure>
+// The size is the screen in the orientation it was calibrated for, a
+// profile of another orientation does not fit the raw coordinates.
+unsigned int tftglSaveTouchCalibration(const char* filename){
+	TftglTouchCalibration m;
+	char tmp[4096];
+	FILE* file;
+	int ok;
+
+	if(snprintf(tmp, sizeof(tmp), "%s.tmp", filename) >= (int)sizeof(tmp)){
+		errorCode = TFTGL_FILE_ERROR;
+		return TFTGL_ERROR;
+	}
+	file = fopen(tmp, "w");
+	if(file == NULL){
+		errorCode = TFTGL_FILE_ERROR;
+		return TFTGL_ERROR;
+	}
+
+	tftglGetTouchMatrix(&m);
+	fprintf(file, "%s %d\n", TOUCH_CALIB_MAGIC, TOUCH_CALIB_VERSION);
+	fprintf(file, "size %u %u\n", LCD_WIDTH, LCD_HEIGHT);
+	fprintf(file, "matrix %d %d %d %d %d %d\n", m.a, m.b, m.c, m.d, m.e, m.f);
+	fprintf(file, "sensitivity %u\n", minTouchPressure);
+
+	// Replace the old profile only once the new one is complete, a power
+	// cut while saving leaves one or the other
+	ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+	ok = (fclose(file) == 0) && ok;
+	if(!ok || rename(tmp, filename) != 0){
+		unlink(tmp);
+		errorCode = TFTGL_FILE_ERROR;
+		return TFTGL_ERROR;
+	}
+	return TFTGL_OK;
+}
+
+unsigned int tftglLoadTouchCalibration(const char* filename){
+	TftglTouchCalibration m;
+	char magic[16];
+	unsigned int width, height, pressure;
+	int version, fields;
+	FILE* file;
+
+	file = fopen(filename, "r");
+	if(file == NULL){
+		errorCode = TFTGL_FILE_ERROR;
+		return TFTGL_ERROR;
+	}
+	fields = fscanf(file, "%15s %d size %u %u matrix %d %d %d %d %d %d sensitivity %u",
+		magic, &version, &width, &height, &m.a, &m.b, &m.c, &m.d, &m.e, &m.f, &pressure);
+	fclose(file);
+
+	if(fields != 11 || strcmp(magic, TOUCH_CALIB_MAGIC) != 0 || version != TOUCH_CALIB_VERSION ||
+		width != LCD_WIDTH || height != LCD_HEIGHT){
+		errorCode = TFTGL_BAD_CALIB;
+		return TFTGL_ERROR;
+	}
+	tftglSetTouchMatrix(&m);
+	minTouchPressure = pressure;
+	return TFTGL_OK;
+}
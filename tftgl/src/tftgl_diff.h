@@ -0,0 +1,240 @@
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+// Size of the square tile (in pixels) that is compared against the
+// last frame sent to the display. Changed tiles next to each other
+// on the same tile row are sent as one area.
+#define TFTGL_DIFF_TILE 16
+
+static unsigned int frameDiffEnabled = 0;
+static unsigned short* framePixels = NULL; // Current frame (RGB-565, top to bottom)
+static unsigned short* shadowPixels = NULL; // Last frame sent to the display
+static unsigned char* tileBitmap = NULL; // One byte per tile, 1 if changed
+static unsigned char* tileValid = NULL; // One byte per tile, 1 if all of it is in the shadow copy
+
+// Converts bottom to top RGB-888 rows (as returned by glReadPixels)
+// into top to bottom RGB-565 rows
+static void tftglConvertRows565(unsigned short* dst, unsigned int dstStride,
+	const unsigned char* src, unsigned int w, unsigned int h){
+	unsigned int u, v;
+	for(v = 0; v < h; v++){
+		const unsigned char* px = &src[(h - 1 - v) * w * 3];
+		unsigned short* out = &dst[v * dstStride];
+		u = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+		for(; u + 8 <= w; u += 8){
+			uint8x8x3_t rgb = vld3_u8(&px[u * 3]);
+			uint16x8_t r = vshlq_n_u16(vmovl_u8(vshr_n_u8(rgb.val[0], 3)), 11);
+			uint16x8_t g = vshlq_n_u16(vmovl_u8(vshr_n_u8(rgb.val[1], 2)), 5);
+			uint16x8_t b = vmovl_u8(vshr_n_u8(rgb.val[2], 3));
+			uint16x8_t res = vorrq_u16(r, vorrq_u16(g, b));
+			vst1q_u16(&out[u], res);
+		}
+#endif
+		for(; u < w; u++){
+			const unsigned char* p = &px[u * 3];
+			out[u] = ((p[0] >> 3) << 11) | ((p[1] >> 2) << 5) | p[2] >> 3;
+		}
+	}
+}
+
+// Same as tftglConvertRows565 for rows that are already RGB-565
+static void tftglFlipRows565(unsigned short* dst, unsigned int dstStride,
+	const unsigned short* src, unsigned int w, unsigned int h){
+	unsigned int v;
+	for(v = 0; v < h; v++){
+		memcpy(&dst[v * dstStride], &src[(h - 1 - v) * w], w * sizeof(unsigned short));
+	}
+}
+
+// Returns non zero if the two rows of n pixels differ
+static int tftglRowsDiffer(const unsigned short* a, const unsigned short* b, unsigned int n){
+	unsigned int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	uint16x8_t acc = vdupq_n_u16(0);
+	for(; i + 8 <= n; i += 8){
+		acc = vorrq_u16(acc, veorq_u16(vld1q_u16(&a[i]), vld1q_u16(&b[i])));
+	}
+	uint32x2_t folded = vreinterpret_u32_u16(vorr_u16(vget_low_u16(acc), vget_high_u16(acc)));
+	if((vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)) != 0)return 1;
+#endif
+	for(; i < n; i++){
+		if(a[i] != b[i])return 1;
+	}
+	return 0;
+}
+
+// Marks the tiles the area covers completely as known to the shadow copy,
+// or every tile it touches as unknown
+static void tftglMarkFrameDiff(unsigned int x, unsigned int y, unsigned int w, unsigned int h,
+	unsigned char valid){
+	unsigned int tilesX, tx, ty;
+	if(!frameDiffEnabled || w == 0 || h == 0)return;
+
+	tilesX = (LCD_WIDTH + TFTGL_DIFF_TILE - 1) / TFTGL_DIFF_TILE;
+	for(ty = y / TFTGL_DIFF_TILE; ty <= (y + h - 1) / TFTGL_DIFF_TILE; ty++){
+		unsigned int top = ty * TFTGL_DIFF_TILE;
+		unsigned int bottom = top + TFTGL_DIFF_TILE;
+		if(bottom > LCD_HEIGHT)bottom = LCD_HEIGHT;
+
+		for(tx = x / TFTGL_DIFF_TILE; tx <= (x + w - 1) / TFTGL_DIFF_TILE; tx++){
+			unsigned int left = tx * TFTGL_DIFF_TILE;
+			unsigned int right = left + TFTGL_DIFF_TILE;
+			if(right > LCD_WIDTH)right = LCD_WIDTH;
+
+			if(!valid || (left >= x && right <= x + w && top >= y && bottom <= y + h)){
+				tileValid[ty * tilesX + tx] = valid;
+			}
+		}
+	}
+}
+
+// The display was written outside of the frame diff upload, the next
+// upload sends the tiles of the area again
+static void tftglInvalidateFrameDiff(unsigned int x, unsigned int y, unsigned int w, unsigned int h){
+	tftglMarkFrameDiff(x, y, w, h, 0);
+}
+
+// The area was filled with one color, which is cheap to keep in the copy
+static void tftglFillFrameDiff(unsigned int x, unsigned int y, unsigned int w, unsigned int h,
+	unsigned short color){
+	unsigned int u, v;
+	if(!frameDiffEnabled)return;
+	for(v = y; v < y + h; v++){
+		unsigned short* row = &shadowPixels[v * LCD_WIDTH];
+		for(u = x; u < x + w; u++)row[u] = color;
+	}
+	tftglMarkFrameDiff(x, y, w, h, 1);
+}
+
+void tftglTerminateFrameDiff(){
+	free(framePixels);
+	free(shadowPixels);
+	free(tileBitmap);
+	free(tileValid);
+	framePixels = NULL;
+	shadowPixels = NULL;
+	tileBitmap = NULL;
+	tileValid = NULL;
+	frameDiffEnabled = 0;
+}
+
+unsigned int tftglInitFrameDiff(unsigned int flags){
+	unsigned int tiles;
+	if(!(flags & TFTGL_FRAME_DIFF)){
+		return TFTGL_OK;
+	}
+
+	tiles = ((LCD_WIDTH + TFTGL_DIFF_TILE - 1) / TFTGL_DIFF_TILE) *
+		((LCD_HEIGHT + TFTGL_DIFF_TILE - 1) / TFTGL_DIFF_TILE);
+
+	framePixels = (unsigned short*)malloc(LCD_WIDTH * LCD_HEIGHT * sizeof(unsigned short));
+	shadowPixels = (unsigned short*)malloc(LCD_WIDTH * LCD_HEIGHT * sizeof(unsigned short));
+	tileBitmap = (unsigned char*)malloc(tiles);
+	tileValid = (unsigned char*)calloc(tiles, 1);
+	if(framePixels == NULL || shadowPixels == NULL || tileBitmap == NULL || tileValid == NULL){
+		tftglTerminateFrameDiff();
+		errorCode = TFTGL_OUT_OF_MEM;
+		return TFTGL_ERROR;
+	}
+
+	frameDiffEnabled = 1;
+
+	// tftglInitDisplay cleared the screen to white, uploads only send what
+	// differs from it. Without the clear nothing is known until sent.
+	if(!(flags & (TFTGL_NO_CLEAR | TFTGL_HEADLESS))){
+		tftglFillFrameDiff(0, 0, LCD_WIDTH, LCD_HEIGHT, 0xFFFF);
+	}
+	return TFTGL_OK;
+}
+
+// The display shows the rows of the scroll area moved up by shift rows
+// (wrapping around), the last frame sent must be moved the same way.
+// The current frame buffer is free to use as temporary storage.
+static void tftglScrollFrameDiff(unsigned int top, unsigned int height, unsigned int shift){
+	unsigned short* area;
+	size_t rowBytes = LCD_WIDTH * sizeof(unsigned short);
+	unsigned int tiles, i;
+	if(!frameDiffEnabled)return;
+	area = &shadowPixels[top * LCD_WIDTH];
+	memcpy(framePixels, area, shift * rowBytes);
+	memmove(area, &area[shift * LCD_WIDTH], (height - shift) * rowBytes);
+	memcpy(&area[(height - shift) * LCD_WIDTH], framePixels, shift * rowBytes);
+
+	// Tiles now hold rows of other tiles, the area is only still known if
+	// all of it was
+	tiles = (LCD_WIDTH + TFTGL_DIFF_TILE - 1) / TFTGL_DIFF_TILE;
+	i = (top / TFTGL_DIFF_TILE) * tiles;
+	tiles *= (top + height - 1) / TFTGL_DIFF_TILE + 1;
+	for(; i < tiles; i++){
+		if(!tileValid[i]){
+			tftglInvalidateFrameDiff(0, top, LCD_WIDTH, height);
+			break;
+		}
+	}
+}
+
+// Sends only tiles of the area that have changed since the last upload.
+// The pixels are bottom to top rows of the area from glReadPixels, the type
+// is either GL_UNSIGNED_BYTE (RGB-888) or GL_UNSIGNED_SHORT_5_6_5.
+static void tftglUploadFrameDiff(unsigned int x, unsigned int y, unsigned int w, unsigned int h,
+	const void* pixels, GLenum type){
+	unsigned int tx0, ty0, tx1, ty1, tilesX, tx, ty, v;
+
+	if(type == GL_UNSIGNED_SHORT_5_6_5){
+		tftglFlipRows565(&framePixels[y * LCD_WIDTH + x], LCD_WIDTH, (const unsigned short*)pixels, w, h);
+	} else {
+		tftglConvertRows565(&framePixels[y * LCD_WIDTH + x], LCD_WIDTH, (const unsigned char*)pixels, w, h);
+	}
+
+	tilesX = (LCD_WIDTH + TFTGL_DIFF_TILE - 1) / TFTGL_DIFF_TILE;
+	tx0 = x / TFTGL_DIFF_TILE;
+	ty0 = y / TFTGL_DIFF_TILE;
+	tx1 = (x + w - 1) / TFTGL_DIFF_TILE;
+	ty1 = (y + h - 1) / TFTGL_DIFF_TILE;
+
+	for(ty = ty0; ty <= ty1; ty++){
+		// Tile row clipped to the area
+		unsigned int top = ty * TFTGL_DIFF_TILE;
+		unsigned int bottom = top + TFTGL_DIFF_TILE;
+		if(top < y)top = y;
+		if(bottom > y + h)bottom = y + h;
+
+		for(tx = tx0; tx <= tx1; tx++){
+			unsigned int left = tx * TFTGL_DIFF_TILE;
+			unsigned int right = left + TFTGL_DIFF_TILE;
+			if(left < x)left = x;
+			if(right > x + w)right = x + w;
+
+			unsigned char changed = !tileValid[ty * tilesX + tx];
+			for(v = top; v < bottom && !changed; v++){
+				changed = tftglRowsDiffer(&framePixels[v * LCD_WIDTH + left],
+					&shadowPixels[v * LCD_WIDTH + left], right - left);
+			}
+			tileBitmap[ty * tilesX + tx] = changed;
+		}
+
+		// Send runs of changed tiles as one area
+		tx = tx0;
+		while(tx <= tx1){
+			if(!tileBitmap[ty * tilesX + tx]){
+				tx++;
+				continue;
+			}
+			unsigned int left = tx * TFTGL_DIFF_TILE;
+			while(tx <= tx1 && tileBitmap[ty * tilesX + tx])tx++;
+			unsigned int right = tx * TFTGL_DIFF_TILE;
+			if(left < x)left = x;
+			if(right > x + w)right = x + w;
+
+			tftglDisplayPush565(left, top, right - left, bottom - top,
+				&framePixels[top * LCD_WIDTH + left], LCD_WIDTH);
+			for(v = top; v < bottom; v++){
+				memcpy(&shadowPixels[v * LCD_WIDTH + left], &framePixels[v * LCD_WIDTH + left],
+					(right - left) * sizeof(unsigned short));
+			}
+			tftglMarkFrameDiff(left, top, right - left, bottom - top, 1);
+		}
+	}
+}
@@ -0,0 +1,111 @@
+// How many disjoint dirty rectangles are tracked at once.
+// If more are added, the new rectangle is merged with the tracked one
+// whose area grows the least by it.
+#define TFTGL_MAX_DIRTY_RECTS 16
+
+static TftglRect dirtyRects[TFTGL_MAX_DIRTY_RECTS];
+static unsigned int dirtyCount = 0;
+
+static unsigned int tftglRectArea(const TftglRect* r){
+	return r->w * r->h;
+}
+
+static void tftglRectUnion(TftglRect* dst, const TftglRect* a, const TftglRect* b){
+	unsigned int x0 = a->x < b->x ? a->x : b->x;
+	unsigned int y0 = a->y < b->y ? a->y : b->y;
+	unsigned int x1 = (a->x + a->w) > (b->x + b->w) ? (a->x + a->w) : (b->x + b->w);
+	unsigned int y1 = (a->y + a->h) > (b->y + b->h) ? (a->y + a->h) : (b->y + b->h);
+	dst->x = x0;
+	dst->y = y0;
+	dst->w = x1 - x0;
+	dst->h = y1 - y0;
+}
+
+static int tftglRectsIntersect(const TftglRect* a, const TftglRect* b){
+	return a->x < b->x + b->w && b->x < a->x + a->w &&
+		a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+static void tftglRemoveDirtyRect(unsigned int i){
+	dirtyRects[i] = dirtyRects[--dirtyCount];
+}
+
+void tftglAddDirtyRect(unsigned int x, unsigned int y, unsigned int w, unsigned int h){
+	unsigned int i, best, bestCost;
+	TftglRect r, u;
+
+	if(x >= LCD_WIDTH || y >= LCD_HEIGHT)return;
+	if(w == 0 || h == 0)return;
+
+	// Check area dimensions
+	if(x + w >= LCD_WIDTH){
+		w = LCD_WIDTH - x;
+	}
+	if(y + h >= LCD_HEIGHT){
+		h = LCD_HEIGHT - y;
+	}
+
+	r.x = x;
+	r.y = y;
+	r.w = w;
+	r.h = h;
+
+	// Merge with every rectangle we overlap, or that we can join without
+	// adding any extra area (for example two neighbours of the same height).
+	// The union may overlap other rectangles, so start again after each merge.
+restart:
+	for(i = 0; i < dirtyCount; i++){
+		tftglRectUnion(&u, &r, &dirtyRects[i]);
+		if(tftglRectsIntersect(&r, &dirtyRects[i]) ||
+			tftglRectArea(&u) == tftglRectArea(&r) + tftglRectArea(&dirtyRects[i])){
+			r = u;
+			tftglRemoveDirtyRect(i);
+			goto restart;
+		}
+	}
+
+	// No room left, merge with the rectangle that grows the least
+	if(dirtyCount == TFTGL_MAX_DIRTY_RECTS){
+		best = 0;
+		bestCost = ~0u;
+		for(i = 0; i < dirtyCount; i++){
+			tftglRectUnion(&u, &r, &dirtyRects[i]);
+			unsigned int cost = tftglRectArea(&u) - tftglRectArea(&dirtyRects[i]);
+			if(cost < bestCost){
+				bestCost = cost;
+				best = i;
+			}
+		}
+		tftglRectUnion(&r, &r, &dirtyRects[best]);
+		tftglRemoveDirtyRect(best);
+		goto restart;
+	}
+
+	dirtyRects[dirtyCount++] = r;
+}
+
+void tftglClearDirtyRects(){
+	dirtyCount = 0;
+}
+
+unsigned int tftglGetDirtyRects(TftglRect* rects, unsigned int max){
+	unsigned int i;
+	if(rects != NULL){
+		for(i = 0; i < dirtyCount && i < max; i++){
+			rects[i] = dirtyRects[i];
+		}
+	}
+	return dirtyCount;
+}
+
+void tftglUploadFboDirty(){
+	unsigned int i;
+	for(i = 0; i < dirtyCount; i++){
+		// The rects are one frame for the frame pacing and tear sync
+		frameContinued = (i > 0);
+		tftglUploadFboArea(dirtyRects[i].x, dirtyRects[i].y,
+			dirtyRects[i].w, dirtyRects[i].h);
+	}
+	frameContinued = 0;
+	dirtyCount = 0;
+}
@@ -0,0 +1,1008 @@
+// Display module: the GPIO wiring of the 8080 parallel bus, the push
+// loops and everything that is the same for all LCD controllers. The
+// controllers are drivers (see TftglDriver) in tftgl_ssd1963.h,
+// tftgl_ili9341.h, tftgl_ili9486.h and tftgl_st7796.h, selected by the
+// TFTGL_DRIVER_ flags of tftglInit.
+
+// Define the following into 1 only if D0 to D15 are consecutive
+// GPIO pins without gaps!
+// Example: D0 -> 12, D1 -> 13, ..., D15 -> 27
+// Using consecutive GPIO saves two table lookups per pixel. Any other
+// wiring uses lookup tables built by tftglInitDisplay.
+#define LCD_DATA_CONSECUTIVE 1
+
+// Select GPIO pins. The numbers must match GPIO number
+// See here: https://learn.sparkfun.com/tutorials/raspberry-gpio/gpio-pinout
+// Example: LCD_D0 is set to GPIO 12 -> physical pin 32
+#define LCD_D0 12
+#define LCD_D1 13
+#define LCD_D2 14
+#define LCD_D3 15
+#define LCD_D4 16
+#define LCD_D5 17
+#define LCD_D6 18
+#define LCD_D7 19
+#define LCD_D8 20
+#define LCD_D9 21
+#define LCD_D10 22
+#define LCD_D11 23
+#define LCD_D12 24
+#define LCD_D13 25
+#define LCD_D14 26
+#define LCD_D15 27
+// Controllers on an 8-bit bus (ILI9341) only use D0 to D7
+
+#define LCD_WR 3
+#define LCD_RS 4
+#define LCD_CS 5
+#define LCD_RESET 6
+
+// Chip select of the second panel, only needed for TFTGL_DUAL_PANEL. The
+// panels share all the other pins. GPIO 7 is CE1 of the SPI, which is free
+// as the touch controller uses CE0. tftglInitDisplay runs after the SPI is
+// started, so the pin is taken back from it.
+#define LCD_CS2 7
+
+// Tear effect output of the LCD, only needed for TFTGL_TEAR_SYNC
+#define LCD_TE 2
+
+// What are the display dimensions? (in pixels, set by the driver)
+static unsigned int LCD_WIDTH = 800;
+static unsigned int LCD_HEIGHT = 480;
+
+// Panels side by side on the same bus, each with its own chip select. The
+// screen is LCD_WIDTH wide, panelWidth columns per panel from the left.
+#define DISPLAY_MAX_PANELS 2
+#define DISPLAY_ALL_PANELS 0xFF
+static const unsigned char panelCs[DISPLAY_MAX_PANELS] = {LCD_CS, LCD_CS2};
+static unsigned int panelCount = 1;
+static unsigned int panelWidth = 800;
+static unsigned int panelSelected = DISPLAY_ALL_PANELS;
+static unsigned int panelInterleave = 0;
+	
+static unsigned int displayInitialized = TFTGL_ERROR;
+static unsigned int displayBottomUp = 0;
+// Rows and columns of the screen are exchanged in frame memory
+static unsigned int displayExchange = 0;
+
+// Address mode (command 0x36) of the orientation, and the one currently
+// set on each panel, which differs while bottom to top rows are streamed
+static unsigned int displayAddressMode = 0x03;
+static unsigned int displayAddressModeSet[DISPLAY_MAX_PANELS] = {0x03, 0x03};
+
+// Hardware scroll area in rows of the screen, see tftglSetScrollArea
+static unsigned int scrollTop = 0;
+static unsigned int scrollHeight = 0;
+static unsigned int scrollOffset = 0;
+static TftglRect scrollExposed;
+static unsigned int scrollExposedValid = 0;
+
+// Set once the controller runs with the configuration of tftglInitDisplay,
+// kept over tftglTerminate for a warm start (see TFTGL_WARM_START)
+static const struct TftglDriverStruct* displayConfigured = NULL;
+static unsigned int displayConfiguredPanels = 0;
+// The display is turned on by the first pixels sent (see TFTGL_NO_CLEAR)
+static unsigned int displayOnPending = 0;
+
+static void tftglDisplayShow();
+
+// Marks a configured controller for the processes started after this one,
+// holds the driver id and the number of panels
+#define DISPLAY_WARM_MARKER "/run/tftgl.warm"
+
+// Reset timing (us). The datasheets need a reset pulse of at least 10 us
+// and 5 ms until the controller takes commands.
+#define DISPLAY_RESET_PULSE 100
+#define DISPLAY_RESET_WAIT 5000
+
+// Moves the last frame of the frame diff upload with the scrolled content
+static void tftglScrollFrameDiff(unsigned int top, unsigned int height, unsigned int shift);
+// Keep the last frame of the frame diff upload up to date with other writes
+static void tftglInvalidateFrameDiff(unsigned int x, unsigned int y, unsigned int w, unsigned int h);
+static void tftglFillFrameDiff(unsigned int x, unsigned int y, unsigned int w, unsigned int h,
+	unsigned short color);
+
+// Data bus writes for the pins above, see LCD_BUS_WRITE
+#include "tftgl_bus.h"
+
+// Use GPIO_WRITE_PIN(pin, HIGH or LOW) to write to pin
+// Use PULSE_LOW to create a pulse (needed by writing pixels) or PULSE_HIGH
+// Use SWAP instead of std::swap (there is no C++ here!)
+// Use if(gpioData != NULL){ // OK } else { // ERROR } to check
+// if GPIO has been initialized!
+
+static void tftglDisplayData(unsigned char data){
+	GPIO_WRITE_PIN(LCD_RS, HIGH);
+	LCD_BUS_WRITE8(data);
+	PULSE_LOW(LCD_WR);
+}
+
+static void tftglDisplayCom(unsigned char data){
+	GPIO_WRITE_PIN(LCD_RS, LOW);
+	LCD_BUS_WRITE8(data);
+	PULSE_LOW(LCD_WR);
+}
+
+#define COMMAND(X) tftglDisplayCom(X)
+#define DATA(X) tftglDisplayData(X)
+
+// A command of an init table, with its parameters and the time to wait
+// after it (us)
+typedef struct {
+	unsigned char command;
+	unsigned char count;
+	unsigned char params[16];
+	unsigned int delay;
+} TftglInitCommand;
+
+#define INIT_TABLE(table) table, sizeof(table) / sizeof(table[0])
+
+static void tftglDisplayRunTable(const TftglInitCommand* table, unsigned int count){
+	unsigned int i, p;
+	for(i = 0; i < count; i++){
+		COMMAND(table[i].command);
+		for(p = 0; p < table[i].count; p++){
+			DATA(table[i].params[p]);
+		}
+		if(table[i].delay > 0){
+			usleep(table[i].delay);
+		}
+	}
+}
+
+// Panel driver. Windows and scroll lines are in frame memory addresses,
+// the orientation is done with the address modes (command 0x36, the bits
+// 0x80 page order, 0x40 column order and 0x20 exchange are the same for
+// all supported controllers).
+typedef struct TftglDriverStruct {
+	unsigned int id; // TFTGL_DRIVER_ flag
+	unsigned int width; // Columns of the frame memory
+	unsigned int height; // Pages of the frame memory, these are the scan lines
+	unsigned int lines; // Scan lines of a frame, including the vertical blank
+	unsigned int flipScan; // Address mode bit 0 flips the scan (SSD1963)
+	unsigned char addressModes[4]; // Landscape, landscape rotated, portrait, portrait rotated
+	
+	// Hardware reset done before, or warm start (see TFTGL_WARM_START)
+	void (*init)(unsigned int warm);
+	void (*setWindow)(unsigned int x, unsigned int y, unsigned int w, unsigned int h);
+	// Push loops, update the pixels and bus writes stats
+	void (*write888)(unsigned int w, unsigned int h, const unsigned char* pixels, int step);
+	void (*write565)(unsigned int w, unsigned int h, const unsigned short* pixels, int stride);
+	void (*fill)(unsigned int rgb, unsigned long count);
+	void (*brightness)(unsigned char val);
+	void (*setScrollArea)(unsigned int top, unsigned int height, unsigned int bottom);
+	void (*setScrollStart)(unsigned int line);
+} TftglDriver;
+
+static const TftglDriver* displayDriver = NULL;
+
+// Writes a pixel on a 16-bit bus, last is the value the bus holds
+#define LCD_PIXEL_WRITE16(rgb, last, elided) { \
+	if((rgb) != last){ \
+		LCD_BUS_WRITE(rgb); \
+		last = (rgb); \
+	} else { \
+		elided++; \
+	} \
+	PULSE_LOW(LCD_WR); }
+
+// Writes a pixel on an 8-bit bus, high byte first. Bytes the bus already
+// holds are not written again, last is the byte the bus holds.
+#define LCD_PIXEL_WRITE8(rgb, last, elided) { \
+	unsigned int hi = (rgb) >> 8, lo = (rgb) & 0xFF; \
+	if(hi != last){ \
+		LCD_BUS_WRITE8(hi); \
+	} else if(lo == hi){ \
+		elided++; \
+	} \
+	PULSE_LOW(LCD_WR); \
+	if(lo != hi){ \
+		LCD_BUS_WRITE8(lo); \
+	} \
+	PULSE_LOW(LCD_WR); \
+	last = lo; }
+
+// The push loops for each bus width. The bus8 argument is a constant in
+// the wrappers of the drivers, so every driver gets its own inner loop
+// without the test.
+
+// Sends RGB-888 rows to the window set before, the next row is step
+// bytes further (negative step for bottom to top rows)
+static inline void tftglBusWrite888(unsigned int w, unsigned int h, const unsigned char* pixels, int step,
+	const unsigned int bus8){
+	unsigned int u, v;
+	const unsigned char* row = pixels;
+	
+	GPIO_WRITE_PIN(LCD_RS, HIGH);
+	
+	// The display latches the data bus on every WR pulse, so runs of
+	// the same color only need the bus to be written once
+	unsigned int last = LCD_BUS_INVALID;
+	unsigned long elided = 0;
+	for(v = 0; v < h; v++, row += step){
+		const unsigned char* px = row;
+		for(u = 0; u < w; u++, px += 3){
+			unsigned int rgb = ((px[0] >> 3) << 11) | ((px[1] >> 2) << 5) | px[2] >> 3;
+			if(bus8){
+				LCD_PIXEL_WRITE8(rgb, last, elided);
+			} else {
+				LCD_PIXEL_WRITE16(rgb, last, elided);
+			}
+		}
+	}
+	
+	STATS_ADD(pixels, w * h);
+	STATS_ADD(busWritesElided, elided);
+}
+
+// Sends RGB-565 rows to the window set before, the next row is stride
+// pixels further (negative stride for bottom to top rows)
+static inline void tftglBusWrite565(unsigned int w, unsigned int h, const unsigned short* pixels, int stride,
+	const unsigned int bus8){
+	unsigned int u, v;
+	const unsigned short* row = pixels;
+
+	GPIO_WRITE_PIN(LCD_RS, HIGH);
+
+	unsigned int last = LCD_BUS_INVALID;
+	unsigned long elided = 0;
+	for(v = 0; v < h; v++, row += stride){
+		for(u = 0; u < w; u++){
+			unsigned int rgb = row[u];
+			if(bus8){
+				LCD_PIXEL_WRITE8(rgb, last, elided);
+			} else {
+				LCD_PIXEL_WRITE16(rgb, last, elided);
+			}
+		}
+	}
+
+	STATS_ADD(pixels, w * h);
+	STATS_ADD(busWritesElided, elided);
+}
+
+// Sends count pixels of one color to the window set before
+static inline void tftglBusFill(unsigned int rgb, unsigned long count, const unsigned int bus8){
+	unsigned long i;
+	
+	GPIO_WRITE_PIN(LCD_RS, HIGH);
+	
+	STATS_ADD(pixels, count);
+	if(bus8 && (rgb >> 8) != (rgb & 0xFF)){
+		// Both bytes have to be written for every pixel
+		for(i = 0; i < count; i++){
+			LCD_BUS_WRITE8(rgb >> 8);
+			PULSE_LOW(LCD_WR);
+			LCD_BUS_WRITE8(rgb);
+			PULSE_LOW(LCD_WR);
+		}
+		return;
+	}
+	
+	// Set GPIO pins of the one bits and clear GPIO pins of the zero bits
+	// once, then only pulse the write pin
+	if(bus8){
+		LCD_BUS_WRITE8(rgb & 0xFF);
+		count *= 2;
+	} else {
+		LCD_BUS_WRITE(rgb);
+	}
+	for(i = 0; i < count; i++){
+		PULSE_LOW(LCD_WR);
+	}
+	STATS_ADD(busWritesElided, (bus8 ? count / 2 : count) - 1);
+}
+
+static void tftglBus16Write888(unsigned int w, unsigned int h, const unsigned char* pixels, int step){
+	tftglBusWrite888(w, h, pixels, step, 0);
+}
+
+static void tftglBus16Write565(unsigned int w, unsigned int h, const unsigned short* pixels, int stride){
+	tftglBusWrite565(w, h, pixels, stride, 0);
+}
+
+static void tftglBus16Fill(unsigned int rgb, unsigned long count){
+	tftglBusFill(rgb, count, 0);
+}
+
+static void tftglBus8Write888(unsigned int w, unsigned int h, const unsigned char* pixels, int step){
+	tftglBusWrite888(w, h, pixels, step, 1);
+}
+
+static void tftglBus8Write565(unsigned int w, unsigned int h, const unsigned short* pixels, int stride){
+	tftglBusWrite565(w, h, pixels, stride, 1);
+}
+
+static void tftglBus8Fill(unsigned int rgb, unsigned long count){
+	tftglBusFill(rgb, count, 1);
+}
+
+// Commands of the MIPI display command set, the SSD1963 uses them as well
+
+static void tftglDcsSetWindow(unsigned int x, unsigned int y, unsigned int w, unsigned int h){
+	w = w - 1 + x;
+	h = h - 1 + y;
+	COMMAND(0x2a); 
+  	DATA(x>>8);
+  	DATA(x);
+  	DATA(w>>8);
+  	DATA(w);
+	COMMAND(0x2b); 
+  	DATA(y>>8);
+  	DATA(y);
+  	DATA(h>>8);
+  	DATA(h);
+	COMMAND(0x2c); 
+}
+
+static void tftglDcsSetScrollArea(unsigned int top, unsigned int height, unsigned int bottom){
+	COMMAND(0x33);
+	DATA(top >> 8);
+	DATA(top);
+	DATA(height >> 8);
+	DATA(height);
+	DATA(bottom >> 8);
+	DATA(bottom);
+}
+
+static void tftglDcsSetScrollStart(unsigned int line){
+	COMMAND(0x37);
+	DATA(line >> 8);
+	DATA(line);
+}
+
+static void tftglDcsBrightness(unsigned char val){
+	COMMAND(0x51); // Write display brightness
+	DATA(val);
+}
+
+// Include panel drivers
+#include "tftgl_ssd1963.h"
+#include "tftgl_ili9341.h"
+#include "tftgl_ili9486.h"
+#include "tftgl_st7796.h"
+
+static const TftglDriver* tftglFindDriver(unsigned int flags){
+	switch(flags & TFTGL_DRIVER_MASK){
+		case TFTGL_DRIVER_ILI9341: return &ili9341Driver;
+		case TFTGL_DRIVER_ILI9486: return &ili9486Driver;
+		case TFTGL_DRIVER_ST7796: return &st7796Driver;
+		default: return &ssd1963Driver;
+	}
+}
+
+// Selects the panel the following commands and pixels go to, or all of
+// them. A single panel stays selected.
+static void tftglDisplaySelect(unsigned int panel){
+	unsigned int p;
+	if(panel == panelSelected || panelCount == 1)return;
+	for(p = 0; p < panelCount; p++){
+		if(panel == DISPLAY_ALL_PANELS || panel == p){
+			GPIO_WRITE_PIN(panelCs[p], LOW);
+		} else {
+			GPIO_WRITE_PIN(panelCs[p], HIGH);
+		}
+	}
+	panelSelected = panel;
+}
+
+static void tftglDisplaySetAddressMode(unsigned int mode){
+	unsigned int p, set = 1;
+	for(p = 0; p < panelCount; p++){
+		if(panelSelected == p || panelSelected == DISPLAY_ALL_PANELS){
+			if(displayAddressModeSet[p] != mode)set = 0;
+			displayAddressModeSet[p] = mode;
+		}
+	}
+	if(set)return;
+	COMMAND(0x36);
+	DATA(mode);
+}
+
+static void tftglDisplaySetWindow(unsigned int x, unsigned int y, unsigned int w, unsigned int h){
+	if(displayExchange){
+		SWAP(x, y);
+		SWAP(w, h);
+	}
+	displayDriver->setWindow(x, y, w, h);
+}
+
+static void tftglDisplaySetXY(unsigned int x, unsigned int y, unsigned int w, unsigned int h){
+	tftglDisplaySetAddressMode(displayAddressMode);
+	tftglDisplaySetWindow(x, y, w, h);
+}
+
+// Same as tftglDisplaySetXY for rows sent from bottom to top. Flipping the
+// vertical address order (page order, or column order where they are
+// exchanged with the screen rows) lets the rows of a glReadPixels buffer be sent
+// in memory order. The window is mirrored the same way.
+static void tftglDisplaySetXYFlipped(unsigned int x, unsigned int y, unsigned int w, unsigned int h){
+	tftglDisplaySetAddressMode(displayAddressMode ^ (displayExchange ? 0x40 : 0x80));
+	tftglDisplaySetWindow(x, LCD_HEIGHT - y - h, w, h);
+}
+
+// Rows of the screen that are contiguous in frame memory
+typedef struct {
+	unsigned int y, h;
+	unsigned int memY;
+} TftglRowRun;
+
+// Splits the screen rows y to y+h-1 into runs that are contiguous in frame
+// memory. The scroll area shows memory rows shifted by the scroll offset
+// (wrapping around), the fixed areas are not moved. Returns the number of
+// runs, at most 4 (top fixed area, two in the scroll area, bottom fixed area).
+static unsigned int tftglDisplayRowRuns(unsigned int y, unsigned int h, TftglRowRun* runs){
+	unsigned int n = 0;
+	unsigned int end = y + h;
+	unsigned int scrollEnd = scrollTop + scrollHeight;
+	
+	if(scrollOffset == 0){
+		runs[0].y = runs[0].memY = y;
+		runs[0].h = h;
+		return 1;
+	}
+	
+	while(y < end){
+		TftglRowRun* run = &runs[n++];
+		run->y = y;
+		if(y < scrollTop){
+			run->h = (end < scrollTop ? end : scrollTop) - y;
+			run->memY = y;
+		} else if(y >= scrollEnd){
+			run->h = end - y;
+			run->memY = y;
+		} else {
+			unsigned int pos = (y - scrollTop + scrollOffset) % scrollHeight;
+			run->h = (end < scrollEnd ? end : scrollEnd) - y;
+			if(run->h > scrollHeight - pos){
+				run->h = scrollHeight - pos;
+			}
+			run->memY = scrollTop + pos;
+		}
+		y += run->h;
+	}
+	return n;
+}
+
+// The functions below send an area to the selected panel, x is a column of
+// the panel. No checks are done here, the area must fit the panel!
+
+static void tftglPanelFillColor(unsigned int x, unsigned int y, unsigned int w, unsigned int h, unsigned int rgb){
+	unsigned int r, n;
+	TftglRowRun runs[4];
+
+	n = tftglDisplayRowRuns(y, h, runs);
+	for(r = 0; r < n; r++){
+		tftglDisplaySetXY(x, runs[r].memY, w, runs[r].h);
+		displayDriver->fill(rgb, w * runs[r].h);
+	}
+}
+
+// Rows of RGB-888 from bottom to top, the next row is stride bytes further
+static void tftglPanelFillPixels(unsigned int x, unsigned int y, unsigned int w, unsigned int h,
+	const unsigned char* pixels, int stride){
+	unsigned int r, n;
+	TftglRowRun runs[4];
+
+	n = tftglDisplayRowRuns(y, h, runs);
+	if(displayBottomUp){
+		// Walk the rows backwards, top run first
+		const unsigned char* row = &pixels[(h - 1) * stride];
+		for(r = 0; r < n; r++){
+			tftglDisplaySetXY(x, runs[r].memY, w, runs[r].h);
+			displayDriver->write888(w, runs[r].h, row, -stride);
+			row -= stride * (int)runs[r].h;
+		}
+	} else {
+		// Rows are bottom to top, stream them in memory order, bottom run first
+		const unsigned char* row = pixels;
+		for(r = n; r-- > 0;){
+			tftglDisplaySetXYFlipped(x, runs[r].memY, w, runs[r].h);
+			displayDriver->write888(w, runs[r].h, row, stride);
+			row += stride * (int)runs[r].h;
+		}
+	}
+}
+
+// Rows of RGB-565 starting with the top row, the next row is stride pixels
+// further (negative stride for bottom to top rows)
+static void tftglPanelPush565(unsigned int x, unsigned int y, unsigned int w, unsigned int h,
+	const unsigned short* pixels, int stride){
+	unsigned int r, n;
+	TftglRowRun runs[4];
+
+	n = tftglDisplayRowRuns(y, h, runs);
+	for(r = 0; r < n; r++){
+		tftglDisplaySetXY(x, runs[r].memY, w, runs[r].h);
+		displayDriver->write565(w, runs[r].h, pixels, stride);
+		pixels += stride * (int)runs[r].h;
+	}
+}
+
+// Rows of RGB-565 from bottom to top, the same as tftglPanelFillPixels
+static void tftglPanelFillPixels565(unsigned int x, unsigned int y, unsigned int w, unsigned int h,
+	const unsigned short* pixels, int stride){
+	unsigned int r, n;
+	TftglRowRun runs[4];
+
+	if(displayBottomUp){
+		tftglPanelPush565(x, y, w, h, &pixels[(h - 1) * stride], -stride);
+	} else {
+		n = tftglDisplayRowRuns(y, h, runs);
+		for(r = n; r-- > 0;){
+			tftglDisplaySetXYFlipped(x, runs[r].memY, w, runs[r].h);
+			displayDriver->write565(w, runs[r].h, pixels, stride);
+			pixels += stride * (int)runs[r].h;
+		}
+	}
+}
+
+// Part of an area on one panel, offset is its first column in the area
+typedef struct {
+	unsigned int panel;
+	unsigned int x, w;
+	unsigned int offset;
+} TftglPanelPart;
+
+// Splits the screen columns x to x+w-1 into the parts on each panel.
+// Returns the number of parts, at most one per panel.
+static unsigned int tftglDisplaySplit(unsigned int x, unsigned int w, TftglPanelPart* parts){
+	unsigned int n = 0;
+	unsigned int start = x;
+	unsigned int end = x + w;
+
+	while(x < end){
+		TftglPanelPart* part = &parts[n++];
+		unsigned int panelEnd;
+		part->panel = x / panelWidth;
+		panelEnd = (part->panel + 1) * panelWidth;
+		part->x = x - part->panel * panelWidth;
+		part->w = (end < panelEnd ? end : panelEnd) - x;
+		part->offset = x - start;
+		x += part->w;
+	}
+	return n;
+}
+
+// Rows sent to one panel before the next one takes its turn, see
+// TFTGL_INTERLEAVE. Without it each panel gets all rows of the area at once.
+#define DISPLAY_INTERLEAVE_ROWS 16
+
+static unsigned int tftglDisplayBand(unsigned int h, unsigned int parts){
+	if(panelInterleave && parts > 1 && h > DISPLAY_INTERLEAVE_ROWS){
+		return DISPLAY_INTERLEAVE_ROWS;
+	}
+	return h;
+}
+
+void tftglFillColor(unsigned int x, unsigned int y, unsigned int w, unsigned int h, const unsigned char* color){
+	unsigned int i, n, v, band;
+	TftglPanelPart parts[DISPLAY_MAX_PANELS];
+
+	if(displayInitialized == TFTGL_ERROR)return;
+	if(x >= LCD_WIDTH || y >= LCD_HEIGHT)return;
+	if(w == 0 || h == 0)return;
+
+	// Check area dimensions
+	if(x + w >= LCD_WIDTH){
+		w = LCD_WIDTH - x;
+	}
+	if(y + h >= LCD_HEIGHT){
+		h = LCD_HEIGHT - y;
+	}
+
+	// Convert RGB-888 to RGB-565
+	unsigned int rgb = ((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | color[2] >> 3;
+	tftglFillFrameDiff(x, y, w, h, rgb);
+
+	n = tftglDisplaySplit(x, w, parts);
+	band = tftglDisplayBand(h, n);
+	for(v = 0; v < h; v += band){
+		unsigned int bh = (h - v < band ? h - v : band);
+		for(i = 0; i < n; i++){
+			tftglDisplaySelect(parts[i].panel);
+			tftglPanelFillColor(parts[i].x, y + v, parts[i].w, bh, rgb);
+		}
+	}
+
+	tftglDisplayShow();
+}
+
+void tftglFillPixels(unsigned int x, unsigned int y, unsigned int w, unsigned int h, const unsigned char* pixels){
+	unsigned int i, n, v, band;
+	TftglPanelPart parts[DISPLAY_MAX_PANELS];
+
+	if(displayInitialized == TFTGL_ERROR)return;
+	if(x >= LCD_WIDTH || y >= LCD_HEIGHT)return;
+	if(w == 0 || h == 0)return;
+
+	int stride = w * 3;
+
+	// Check area dimensions, rows below the screen come first in the buffer
+	if(x + w >= LCD_WIDTH){
+		w = LCD_WIDTH - x;
+	}
+	if(y + h >= LCD_HEIGHT){
+		pixels += (y + h - LCD_HEIGHT) * stride;
+		h = LCD_HEIGHT - y;
+	}
+
+	tftglInvalidateFrameDiff(x, y, w, h);
+
+	// The rows of a band are the last ones of the rest of the buffer
+	n = tftglDisplaySplit(x, w, parts);
+	band = tftglDisplayBand(h, n);
+	for(v = 0; v < h; v += band){
+		unsigned int bh = (h - v < band ? h - v : band);
+		for(i = 0; i < n; i++){
+			tftglDisplaySelect(parts[i].panel);
+			tftglPanelFillPixels(parts[i].x, y + v, parts[i].w, bh,
+				&pixels[(h - v - bh) * stride + parts[i].offset * 3], stride);
+		}
+	}
+
+	tftglDisplayShow();
+}
+
+// Sends RGB-565 pixels starting with the top row, the next row is
+// stride pixels further (negative stride for bottom to top rows).
+// No checks are done here, the area must fit the screen!
+static void tftglDisplayPush565(unsigned int x, unsigned int y, unsigned int w, unsigned int h,
+	const unsigned short* pixels, int stride){
+	unsigned int i, n, v, band;
+	TftglPanelPart parts[DISPLAY_MAX_PANELS];
+
+	// Nothing to send to in headless mode
+	if(displayInitialized == TFTGL_ERROR)return;
+
+	n = tftglDisplaySplit(x, w, parts);
+	band = tftglDisplayBand(h, n);
+	for(v = 0; v < h; v += band){
+		unsigned int bh = (h - v < band ? h - v : band);
+		for(i = 0; i < n; i++){
+			tftglDisplaySelect(parts[i].panel);
+			tftglPanelPush565(parts[i].x, y + v, parts[i].w, bh,
+				pixels + (int)v * stride + parts[i].offset, stride);
+		}
+	}
+}
+
+void tftglFillPixels565(unsigned int x, unsigned int y, unsigned int w, unsigned int h, const unsigned short* pixels){
+	unsigned int i, n, v, band;
+	TftglPanelPart parts[DISPLAY_MAX_PANELS];
+
+	if(displayInitialized == TFTGL_ERROR)return;
+	if(x >= LCD_WIDTH || y >= LCD_HEIGHT)return;
+	if(w == 0 || h == 0)return;
+
+	int stride = w;
+
+	// Check area dimensions, rows below the screen come first in the buffer
+	if(x + w >= LCD_WIDTH){
+		w = LCD_WIDTH - x;
+	}
+	if(y + h >= LCD_HEIGHT){
+		pixels += (y + h - LCD_HEIGHT) * stride;
+		h = LCD_HEIGHT - y;
+	}
+
+	tftglInvalidateFrameDiff(x, y, w, h);
+
+	// Rows are bottom to top, the same as tftglFillPixels
+	n = tftglDisplaySplit(x, w, parts);
+	band = tftglDisplayBand(h, n);
+	for(v = 0; v < h; v += band){
+		unsigned int bh = (h - v < band ? h - v : band);
+		for(i = 0; i < n; i++){
+			tftglDisplaySelect(parts[i].panel);
+			tftglPanelFillPixels565(parts[i].x, y + v, parts[i].w, bh,
+				&pixels[(h - v - bh) * stride + parts[i].offset], stride);
+		}
+	}
+
+	tftglDisplayShow();
+}
+
+void tftglPushPixels565(unsigned int x, unsigned int y, unsigned int w, unsigned int h,
+	const unsigned short* pixels, unsigned int stride){
+	if(displayInitialized == TFTGL_ERROR)return;
+	if(x >= LCD_WIDTH || y >= LCD_HEIGHT)return;
+	if(w == 0 || h == 0)return;
+
+	// Check area dimensions, rows are top to bottom so the rest are cut off
+	if(x + w >= LCD_WIDTH){
+		w = LCD_WIDTH - x;
+	}
+	if(y + h >= LCD_HEIGHT){
+		h = LCD_HEIGHT - y;
+	}
+
+	tftglInvalidateFrameDiff(x, y, w, h);
+	tftglDisplayPush565(x, y, w, h, pixels, stride);
+	tftglDisplayShow();
+}
+
+// Selects the driver and sets the screen dimensions of the orientation,
+// also used in headless mode where there is no display to initialize
+static void tftglSetOrientation(unsigned int flags){
+	unsigned int mode = (flags & TFTGL_PORTRAIT ? 2 : 0) | (flags & TFTGL_ROTATE_180 ? 1 : 0);
+	
+	displayDriver = tftglFindDriver(flags);
+	displayAddressMode = displayDriver->addressModes[mode];
+	displayExchange = (displayAddressMode & 0x20) != 0;
+	displayBottomUp = flags & TFTGL_BOTTOM_UP;
+	
+	// The display reset clears the scroll area
+	scrollTop = scrollHeight = scrollOffset = 0;
+	scrollExposedValid = 0;
+	
+	LCD_WIDTH = displayDriver->width;
+	LCD_HEIGHT = displayDriver->height;
+	if(displayExchange){
+		SWAP(LCD_WIDTH, LCD_HEIGHT);
+	}
+	
+	// The panels are side by side along the screen rows
+	panelCount = (flags & TFTGL_DUAL_PANEL ? 2 : 1);
+	panelInterleave = (flags & TFTGL_INTERLEAVE) != 0;
+	panelWidth = LCD_WIDTH;
+	LCD_WIDTH = panelWidth * panelCount;
+}
+
+// The controller keeps its configuration until the power goes off. It is
+// configured if this process did it before, or any process since the boot
+// (the marker file is on a tmpfs). Only with the same driver and panels,
+// another configuration needs the full init.
+static unsigned int tftglDisplayIsConfigured(){
+	if(displayConfigured == displayDriver && displayConfiguredPanels == panelCount)return 1;
+#ifndef TFTGL_SIM
+	FILE* marker = fopen(DISPLAY_WARM_MARKER, "r");
+	unsigned int id, panels, match = 0;
+	if(marker != NULL){
+		match = fscanf(marker, "%u %u", &id, &panels) == 2 &&
+			id == displayDriver->id && panels == panelCount;
+		fclose(marker);
+	}
+	return match;
+#else
+	return 0;
+#endif
+}
+
+static void tftglDisplaySetConfigured(){
+	displayConfigured = displayDriver;
+	displayConfiguredPanels = panelCount;
+#ifndef TFTGL_SIM
+	FILE* marker = fopen(DISPLAY_WARM_MARKER, "w");
+	if(marker != NULL){
+		fprintf(marker, "%u %u\n", displayDriver->id, panelCount);
+		fclose(marker);
+	}
+#endif
+}
+
+// The reset drops the configuration, an init that does not finish must
+// not leave the marker for a warm start
+static void tftglDisplayClearConfigured(){
+	displayConfigured = NULL;
+	displayConfiguredPanels = 0;
+#ifndef TFTGL_SIM
+	unlink(DISPLAY_WARM_MARKER);
+#endif
+}
+
+// Turns the display on with the first pixels sent, see TFTGL_NO_CLEAR
+static void tftglDisplayShow(){
+	if(displayOnPending && displayInitialized == TFTGL_OK){
+		tftglDisplaySelect(DISPLAY_ALL_PANELS);
+		COMMAND(0x29); // Display on
+		displayOnPending = 0;
+	}
+}
+
+unsigned int tftglInitDisplay(unsigned int flags){
+	unsigned int warm;
+	
+	if(gpioData == NULL){
+		errorCode = TFTGL_GPIO_ERROR;
+		return TFTGL_ERROR;
+	}
+	
+	tftglSetOrientation(flags);
+	
+	tftglInitBusTables();
+#ifdef TFTGL_SIM
+	tftglSimSetController(displayDriver->id);
+#endif
+	
+	bcm2835_gpio_fsel(LCD_D0, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_D1, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_D2, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_D3, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_D4, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_D5, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_D6, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_D7, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_D8, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_D9, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_D10, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_D11, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_D12, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_D13, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_D14, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_D15, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_WR, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_RS, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_CS, BCM2835_GPIO_FSEL_OUTP);
+	bcm2835_gpio_fsel(LCD_RESET, BCM2835_GPIO_FSEL_OUTP);
+	if(panelCount > 1){
+		bcm2835_gpio_fsel(LCD_CS2, BCM2835_GPIO_FSEL_OUTP);
+		GPIO_WRITE_PIN(LCD_CS2, LOW);
+	}
+	
+	// All panels are configured the same way at once
+	GPIO_WRITE_PIN(LCD_CS, LOW);
+	panelSelected = DISPLAY_ALL_PANELS;
+	
+	warm = (flags & TFTGL_WARM_START) && tftglDisplayIsConfigured();
+	
+	if(!warm){
+		tftglDisplayClearConfigured();
+		GPIO_WRITE_PIN(LCD_RESET, HIGH);
+		usleep(DISPLAY_RESET_PULSE);
+		GPIO_WRITE_PIN(LCD_RESET, LOW);
+		usleep(DISPLAY_RESET_PULSE);
+		GPIO_WRITE_PIN(LCD_RESET, HIGH);
+		usleep(DISPLAY_RESET_WAIT);
+	}
+	
+	displayDriver->init(warm);
+  
+	COMMAND(0x36);		//rotation
+	DATA(displayAddressMode);
+	displayAddressModeSet[0] = displayAddressModeSet[1] = displayAddressMode;
+  
+	tftglDisplaySetXY(0, 0, panelWidth, LCD_HEIGHT);
+	
+	// Without the clear the display shows whatever is in its memory, which
+	// is garbage after a cold start, so it stays off until the first frame.
+	// After a warm start it still shows the last frame of the previous run.
+	displayOnPending = 0;
+	if(!(flags & TFTGL_NO_CLEAR) || warm){
+		COMMAND(0x29);		//display on
+	} else {
+		displayOnPending = 1;
+	}
+	COMMAND(0x2C);
+
+	//GPIO_WRITE_PIN(LCD_CS, HIGH);
+	
+	displayInitialized = TFTGL_OK;
+	tftglDisplaySetConfigured();
+	
+	if(!(flags & TFTGL_NO_CLEAR)){
+		static const unsigned char color[3] = {255, 255, 255};
+		tftglFillColor(0, 0, LCD_WIDTH, LCD_HEIGHT, color);
+	}
+	
+	return TFTGL_OK;
+}
+
+void tftgSetBrightness(unsigned char val){
+	if(displayInitialized == TFTGL_ERROR)return;
+	tftglDisplaySelect(DISPLAY_ALL_PANELS);
+	displayDriver->brightness(val);
+}
+
+unsigned int tftglDisplayIsInit(){
+	return (displayInitialized == TFTGL_ERROR ? TFTGL_ERROR : TFTGL_OK);
+}
+
+void tftglTerminateDisplay(){
+	displayInitialized = TFTGL_ERROR;
+}
+
+unsigned int tftglGetWidth(){
+	return LCD_WIDTH;
+}
+
+unsigned int tftglGetHeight(){
+	return LCD_HEIGHT;
+}
+
+// Hardware scrolling. The frame memory rows of the scroll area are shown
+// shifted by the scroll offset, so scrolling only needs the newly exposed
+// rows to be sent. All drawing functions use screen coordinates and are
+// remapped to frame memory, see tftglDisplayRowRuns.
+unsigned int tftglSetScrollArea(unsigned int top, unsigned int bottom){
+	// The LCD scrolls along its lines, these must be the screen rows in order
+	if((displayAddressMode & 0xA0) || top + bottom >= LCD_HEIGHT){
+		errorCode = TFTGL_BAD_SCROLL;
+		return TFTGL_ERROR;
+	}
+	
+	// Frame memory is shown unshifted again, nothing is where it was
+	if(scrollOffset != 0){
+		tftglInvalidateFrameDiff(0, 0, LCD_WIDTH, LCD_HEIGHT);
+		scrollExposed.x = 0;
+		scrollExposed.y = 0;
+		scrollExposed.w = LCD_WIDTH;
+		scrollExposed.h = LCD_HEIGHT;
+		scrollExposedValid = 1;
+	}
+	
+	scrollTop = top;
+	scrollHeight = LCD_HEIGHT - top - bottom;
+	scrollOffset = 0;
+	
+	if(displayInitialized == TFTGL_OK){
+		tftglDisplaySelect(DISPLAY_ALL_PANELS);
+		displayDriver->setScrollArea(top, scrollHeight, bottom);
+		displayDriver->setScrollStart(top);
+	}
+	return TFTGL_OK;
+}
+
+void tftglScroll(int lines){
+	unsigned int n, shift, y, h;
+	
+	if(scrollHeight == 0 || lines == 0)return;
+	
+	n = (lines < 0 ? -lines : lines);
+	if(n > scrollHeight)n = scrollHeight;
+	shift = (unsigned int)(((lines % (int)scrollHeight) + (int)scrollHeight) % (int)scrollHeight);
+	
+	scrollOffset = (scrollOffset + shift) % scrollHeight;
+	if(displayInitialized == TFTGL_OK){
+		tftglDisplaySelect(DISPLAY_ALL_PANELS);
+		displayDriver->setScrollStart(scrollTop + scrollOffset);
+	}
+	
+	if(shift != 0){
+		tftglScrollFrameDiff(scrollTop, scrollHeight, shift);
+	}
+	
+	// Rows that came into view, at the bottom when scrolling up
+	y = (lines > 0 ? scrollTop + scrollHeight - n : scrollTop);
+	h = n;
+	
+	// Exposed rows not sent yet moved with the content
+	if(scrollExposedValid){
+		int oldTop = scrollExposed.y;
+		int oldBottom = scrollExposed.y + scrollExposed.h;
+		if(oldTop >= (int)scrollTop && oldBottom <= (int)(scrollTop + scrollHeight)){
+			oldTop -= lines;
+			oldBottom -= lines;
+			if(oldTop < (int)scrollTop)oldTop = scrollTop;
+			if(oldBottom > (int)(scrollTop + scrollHeight))oldBottom = scrollTop + scrollHeight;
+		}
+		if(oldTop < oldBottom){
+			if(oldTop < (int)y){
+				h += y - oldTop;
+				y = oldTop;
+			}
+			if(oldBottom > (int)(y + h)){
+				h = oldBottom - y;
+			}
+		}
+	}
+	
+	scrollExposed.x = 0;
+	scrollExposed.y = y;
+	scrollExposed.w = LCD_WIDTH;
+	scrollExposed.h = h;
+	scrollExposedValid = 1;
+}
+
+unsigned int tftglGetScrollOffset(){
+	return scrollOffset;
+}
+
+unsigned int tftglGetScrollExposed(TftglRect* rect){
+	if(!scrollExposedValid)return 0;
+	if(rect != NULL){
+		*rect = scrollExposed;
+	}
+	scrollExposedValid = 0;
+	return 1;
+}
@@ -0,0 +1,147 @@
+// Filter pipeline of the touch readings, the same code for the driver and
+// for bench/replay.c which runs recorded readings through it. A reading is
+// the X samples, the Y samples, Z1 and Z2 (see tftglBuildTouchBatches):
+//   1. The samples of each axis are combined, the median or the trimmed
+//      mean drop single noisy conversions that would drag a plain mean.
+//   2. Readings whose samples spread too far (the pen moved or lifted
+//      during the reading) or with too light a touch are skipped.
+//   3. The 1-euro filter smooths each axis, strongly while it is still
+//      and less and less as it moves faster, so there is little jitter on
+//      a held finger and little lag on a swipe. Lighter touches than the
+//      firmest of the stroke are trusted less.
+// Positions stay in raw units, tftglTouchMap turns them to pixels.
+
+#include <string.h>
+#include <tftgl.h>
+
+#define TOUCH_MAX_SAMPLES 16
+// Largest range of the samples of an axis (raw units), without the
+// lowest and highest one unless combined as a plain mean
+#define TOUCH_SPREAD 64
+// Cutoff of the speed estimate of the 1-euro filter (Hz)
+#define TOUCH_EURO_DCUTOFF 1.0f
+// Lowest weight of a light touch, the filter still follows lifting pens,
+// and the resistance above the firmest one that still counts as firm
+#define TOUCH_EURO_MIN_WEIGHT 0.25f
+#define TOUCH_EURO_FIRM 1.25f
+
+// Results of a reading
+#define TOUCH_UP 0
+#define TOUCH_PRESSED 1
+#define TOUCH_UNSTABLE 2
+
+#define TOUCH_FILTER_DEFAULT {5, TFTGL_TOUCH_TRIMMED, 0, 1.0f, 0.02f}
+
+// State of the 1-euro filter, reset when the pen goes up
+typedef struct {
+	unsigned int started;
+	unsigned long micros;
+	float x, y;
+	float dx, dy;
+	unsigned int firmest; // Lowest touch resistance of the stroke
+} TftglTouchEuro;
+
+static void tftglTouchEuroReset(TftglTouchEuro* euro){
+	memset(euro, 0, sizeof(TftglTouchEuro));
+}
+
+// Combines the samples of an axis, sorts them in place. Returns the value
+// and the spread for the stability check.
+static unsigned int tftglTouchCombine(unsigned int* samples, unsigned int n, unsigned int combine,
+	unsigned int* spread){
+	unsigned int i, j, sum = 0, trim;
+
+	// Insertion sort, there are only a few
+	for(i = 1; i < n; i++){
+		unsigned int v = samples[i];
+		for(j = i; j > 0 && samples[j - 1] > v; j--)samples[j] = samples[j - 1];
+		samples[j] = v;
+	}
+
+	trim = (combine != TFTGL_TOUCH_MEAN && n >= 3) ? 1 : 0;
+	*spread = samples[n - 1 - trim] - samples[trim];
+
+	switch(combine){
+		case TFTGL_TOUCH_MEDIAN:
+			if(n % 2 == 1)return samples[n / 2];
+			return (samples[n / 2 - 1] + samples[n / 2] + 1) / 2;
+		case TFTGL_TOUCH_TRIMMED:
+			for(i = trim; i < n - trim; i++)sum += samples[i];
+			return (sum + (n - 2 * trim) / 2) / (n - 2 * trim);
+		default:
+			for(i = 0; i < n; i++)sum += samples[i];
+			return (sum + n / 2) / n;
+	}
+}
+
+// Touch resistance in 1/4096 of the X plate, lower is a firmer touch
+static unsigned int tftglTouchResistance(unsigned int x, unsigned int z1, unsigned int z2){
+	if(z1 == 0)return 0xFFFFFFFF;
+	if(z2 <= z1)return 0;
+	return (unsigned int)((unsigned long long)x * (z2 - z1) / z1);
+}
+
+static float tftglTouchEuroAlpha(float cutoff, float dt){
+	float tau = 1.0f / (6.2831853f * cutoff);
+	return 1.0f / (1.0f + tau / dt);
+}
+
+static float tftglTouchEuroAxis(const TftglTouchFilter* filter, float* value, float* speed,
+	float raw, float dt, float weight){
+	float a;
+
+	// Speed, smoothed itself so the noise does not open the filter
+	a = tftglTouchEuroAlpha(TOUCH_EURO_DCUTOFF, dt);
+	*speed += a * ((raw - *value) / dt - *speed);
+
+	a = tftglTouchEuroAlpha(filter->minCutoff + filter->beta * (*speed < 0 ? -*speed : *speed), dt);
+	*value += a * weight * (raw - *value);
+	return *value;
+}
+
+static void tftglTouchEuroApply(TftglTouchEuro* euro, const TftglTouchFilter* filter,
+	unsigned int* x, unsigned int* y, unsigned int resistance, unsigned long micros){
+	float dt, weight;
+
+	if(!euro->started || micros <= euro->micros){
+		if(!euro->started){
+			euro->started = 1;
+			euro->x = *x;
+			euro->y = *y;
+			euro->firmest = resistance;
+		}
+		euro->micros = micros;
+		*x = (unsigned int)(euro->x + 0.5f);
+		*y = (unsigned int)(euro->y + 0.5f);
+		return;
+	}
+	dt = (micros - euro->micros) / 1000000.0f;
+	euro->micros = micros;
+
+	if(resistance < euro->firmest)euro->firmest = resistance;
+	weight = resistance > 0 ? TOUCH_EURO_FIRM * euro->firmest / resistance : 1.0f;
+	if(weight > 1.0f)weight = 1.0f;
+	if(weight < TOUCH_EURO_MIN_WEIGHT)weight = TOUCH_EURO_MIN_WEIGHT;
+
+	*x = (unsigned int)(tftglTouchEuroAxis(filter, &euro->x, &euro->dx, *x, dt, weight) + 0.5f);
+	*y = (unsigned int)(tftglTouchEuroAxis(filter, &euro->y, &euro->dy, *y, dt, weight) + 0.5f);
+}
+
+// Runs a reading through the pipeline, the results are laid out as
+// filter->samples X, filter->samples Y, Z1 and Z2. The samples are sorted
+// in place. Returns TOUCH_PRESSED with the raw position or TOUCH_UNSTABLE.
+static unsigned int tftglTouchFilterReading(const TftglTouchFilter* filter, TftglTouchEuro* euro,
+	unsigned int* results, unsigned int* x, unsigned int* y, unsigned long micros){
+	unsigned int n = filter->samples;
+	unsigned int spreadX, spreadY, resistance;
+
+	*x = tftglTouchCombine(&results[0], n, filter->combine, &spreadX);
+	*y = tftglTouchCombine(&results[n], n, filter->combine, &spreadY);
+	if(spreadX > TOUCH_SPREAD || spreadY > TOUCH_SPREAD)return TOUCH_UNSTABLE;
+
+	resistance = tftglTouchResistance(*x, results[n * 2], results[n * 2 + 1]);
+	if(filter->maxResistance > 0 && resistance > filter->maxResistance)return TOUCH_UNSTABLE;
+
+	if(filter->minCutoff > 0)tftglTouchEuroApply(euro, filter, x, y, resistance, micros);
+	return TOUCH_PRESSED;
+}
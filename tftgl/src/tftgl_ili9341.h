@@ -0,0 +1,61 @@
+// ILI9341 driver, 240x320 panel on an 8-bit bus (D0 to D7, two writes per
+// pixel). The frame rate is set to 70 Hz, the frame is 320 lines and 4
+// lines of porches.
+
+// Power up, only needed after a reset. A panel that was running before
+// the reset takes sleep out no sooner than 120 ms after it, the wait of
+// the software reset covers the hardware reset before it as well. The
+// other commands only need 5 ms, as after sleep out.
+static const TftglInitCommand ili9341InitPower[] = {
+	{0x01, 0, {0}, 120000},	// Software reset
+	{0xCF, 3, {0x00, 0xC1, 0x30}, 0},	// Power control B
+	{0xED, 4, {0x64, 0x03, 0x12, 0x81}, 0},	// Power on sequence control
+	{0xE8, 3, {0x85, 0x00, 0x78}, 0},	// Driver timing control A
+	{0xCB, 5, {0x39, 0x2C, 0x00, 0x34, 0x02}, 0},	// Power control A
+	{0xF7, 1, {0x20}, 0},	// Pump ratio control
+	{0xEA, 2, {0x00, 0x00}, 0},	// Driver timing control B
+	{0xC0, 1, {0x23}, 0},	// Power control 1, VRH 4.6 V
+	{0xC1, 1, {0x10}, 0},	// Power control 2
+	{0xC5, 2, {0x3E, 0x28}, 0},	// VCOM control 1
+	{0xC7, 1, {0x86}, 0},	// VCOM control 2
+	{0xB1, 2, {0x00, 0x1B}, 0},	// Frame rate control, 70 Hz
+	{0xB6, 3, {0x08, 0x82, 0x27}, 0},	// Display function control
+	{0xF2, 1, {0x00}, 0},	// 3 gamma off
+	{0x26, 1, {0x01}, 0},	// Gamma curve 1
+	{0xE0, 15, {0x0F, 0x31, 0x2B, 0x0C, 0x0E, 0x08, 0x4E, 0xF1, 0x37, 0x07, 0x10, 0x03, 0x0E, 0x09, 0x00}, 0},	// Positive gamma
+	{0xE1, 15, {0x00, 0x0E, 0x14, 0x03, 0x11, 0x07, 0x31, 0xC1, 0x48, 0x08, 0x0F, 0x0C, 0x31, 0x36, 0x0F}, 0},	// Negative gamma
+	{0x53, 1, {0x24}, 0},	// Brightness control on
+	{0x51, 1, {0x00}, 0},	// Initial brightness to 0%
+	{0x11, 0, {0}, 5000},	// Sleep out
+};
+
+// Interface, needs no waits. Also sets everything a warm start may find
+// changed back to the reset defaults.
+static const TftglInitCommand ili9341InitPanel[] = {
+	{0x3A, 1, {0x55}, 0},	// Pixel format, 16-bit 565
+	{0x33, 6, {0x00, 0x00, 0x01, 0x40, 0x00, 0x00}, 0},	// Scroll area, all of the screen
+	{0x37, 2, {0x00, 0x00}, 0},	// Scroll start
+	{0x34, 0, {0}, 0},	// Tear effect off
+};
+
+static void tftglIli9341Init(unsigned int warm){
+	if(!warm){
+		tftglDisplayRunTable(INIT_TABLE(ili9341InitPower));
+	}
+	tftglDisplayRunTable(INIT_TABLE(ili9341InitPanel));
+}
+
+// The panel is BGR, all address modes set the BGR bit (0x08)
+static const TftglDriver ili9341Driver = {
+	TFTGL_DRIVER_ILI9341,
+	240, 320, 324, 0,
+	{0x68, 0xA8, 0x08, 0xC8},
+	tftglIli9341Init,
+	tftglDcsSetWindow,
+	tftglBus8Write888,
+	tftglBus8Write565,
+	tftglBus8Fill,
+	tftglDcsBrightness,
+	tftglDcsSetScrollArea,
+	tftglDcsSetScrollStart
+};
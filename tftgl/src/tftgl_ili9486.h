@@ -0,0 +1,50 @@
+// ILI9486 driver, 320x480 panel on a 16-bit bus. The frame is 480 lines
+// and 4 lines of porches at about 60 Hz.
+
+// Power up, only needed after a reset. The ILI9486 takes no sleep out
+// until 120 ms after a hardware or software reset of a panel that was
+// awake, hence the long wait of the software reset. 5 ms after sleep out.
+static const TftglInitCommand ili9486InitPower[] = {
+	{0x01, 0, {0}, 120000},	// Software reset
+	{0xC0, 2, {0x0E, 0x0E}, 0},	// Power control 1
+	{0xC1, 2, {0x41, 0x00}, 0},	// Power control 2
+	{0xC2, 1, {0x55}, 0},	// Power control 3
+	{0xC5, 4, {0x00, 0x00, 0x00, 0x00}, 0},	// VCOM control
+	{0xE0, 15, {0x0F, 0x1F, 0x1C, 0x0C, 0x0F, 0x08, 0x48, 0x98, 0x37, 0x0A, 0x13, 0x04, 0x11, 0x0D, 0x00}, 0},	// Positive gamma
+	{0xE1, 15, {0x0F, 0x32, 0x2E, 0x0B, 0x0D, 0x05, 0x47, 0x75, 0x37, 0x06, 0x10, 0x03, 0x24, 0x20, 0x00}, 0},	// Negative gamma
+	{0x20, 0, {0}, 0},	// Inversion off
+	{0x53, 1, {0x24}, 0},	// Brightness control on
+	{0x51, 1, {0x00}, 0},	// Initial brightness to 0%
+	{0x11, 0, {0}, 5000},	// Sleep out
+};
+
+// Interface, needs no waits. Also sets everything a warm start may find
+// changed back to the reset defaults.
+static const TftglInitCommand ili9486InitPanel[] = {
+	{0x3A, 1, {0x55}, 0},	// Pixel format, 16-bit 565
+	{0x33, 6, {0x00, 0x00, 0x01, 0xE0, 0x00, 0x00}, 0},	// Scroll area, all of the screen
+	{0x37, 2, {0x00, 0x00}, 0},	// Scroll start
+	{0x34, 0, {0}, 0},	// Tear effect off
+};
+
+static void tftglIli9486Init(unsigned int warm){
+	if(!warm){
+		tftglDisplayRunTable(INIT_TABLE(ili9486InitPower));
+	}
+	tftglDisplayRunTable(INIT_TABLE(ili9486InitPanel));
+}
+
+// The panel is BGR, all address modes set the BGR bit (0x08)
+static const TftglDriver ili9486Driver = {
+	TFTGL_DRIVER_ILI9486,
+	320, 480, 484, 0,
+	{0x68, 0xA8, 0x08, 0xC8},
+	tftglIli9486Init,
+	tftglDcsSetWindow,
+	tftglBus16Write888,
+	tftglBus16Write565,
+	tftglBus16Fill,
+	tftglDcsBrightness,
+	tftglDcsSetScrollArea,
+	tftglDcsSetScrollStart
+};
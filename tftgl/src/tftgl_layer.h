@@ -0,0 +1,232 @@
+// Background cache and overlay layer. A static background is rendered once
+// and kept as RGB-565 on the CPU. The parts that change are rendered into
+// an RGBA framebuffer object (the overlay), and only the dirty rectangles
+// of it are read back and blended over the cached background on the CPU.
+// The background is never rendered or read again.
+//
+// The overlay holds premultiplied alpha, which is what nanovg renders.
+// Blending is done with NEON when the compiler targets it (make NEON=1 on
+// a 32-bit Raspberry Pi OS), eight pixels at a time.
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+static unsigned short* layerBackground = NULL; // Top to bottom rows
+static unsigned char* layerRead = NULL; // Overlay pixels of a rectangle
+static unsigned short* layerOut = NULL; // Blended pixels of a rectangle
+static GLuint layerTex = 0;
+static GLuint layerStencil = 0;
+static GLuint layerFbo = 0;
+
+// Blends one row of overlay pixels over the background, out = overlay +
+// background * (255 - alpha) / 255 for every channel.
+static void tftglLayerBlendRow(unsigned short* dst, const unsigned short* bg, const unsigned char* rgba, unsigned int w){
+	unsigned int x = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	for(; x + 8 <= w; x += 8){
+		uint8x8x4_t o = vld4_u8(&rgba[x * 4]);
+		uint16x8_t b = vld1q_u16(&bg[x]);
+		uint8x8_t inv = vmvn_u8(o.val[3]);
+		uint8x8_t r, g, bl;
+		uint16x8_t t, p;
+
+		// Background to 8 bits per channel, the top bits repeated below
+		r = vshrn_n_u16(b, 8);
+		g = vshrn_n_u16(b, 3);
+		bl = vmovn_u16(vshlq_n_u16(b, 3));
+		r = vsri_n_u8(r, r, 5);
+		g = vsri_n_u8(g, g, 6);
+		bl = vsri_n_u8(bl, bl, 5);
+
+		// Exact division by 255: (t + ((t + 128) >> 8) + 128) >> 8
+		t = vmull_u8(r, inv);
+		r = vqadd_u8(o.val[0], vraddhn_u16(t, vrshrq_n_u16(t, 8)));
+		t = vmull_u8(g, inv);
+		g = vqadd_u8(o.val[1], vraddhn_u16(t, vrshrq_n_u16(t, 8)));
+		t = vmull_u8(bl, inv);
+		bl = vqadd_u8(o.val[2], vraddhn_u16(t, vrshrq_n_u16(t, 8)));
+
+		// Back to RGB-565
+		p = vshll_n_u8(r, 8);
+		p = vsriq_n_u16(p, vshll_n_u8(g, 8), 5);
+		p = vsriq_n_u16(p, vshll_n_u8(bl, 8), 11);
+		vst1q_u16(&dst[x], p);
+	}
+#endif
+
+	for(; x < w; x++){
+		const unsigned char* o = &rgba[x * 4];
+		unsigned int c = bg[x];
+		unsigned int inv = 255 - o[3];
+		unsigned int r, g, b, t;
+
+		if(o[3] == 0){
+			dst[x] = c;
+			continue;
+		}
+		r = (c >> 11) << 3;
+		g = ((c >> 5) & 0x3F) << 2;
+		b = (c & 0x1F) << 3;
+		r |= r >> 5;
+		g |= g >> 6;
+		b |= b >> 5;
+
+		t = r * inv;
+		r = o[0] + ((t + ((t + 128) >> 8) + 128) >> 8);
+		t = g * inv;
+		g = o[1] + ((t + ((t + 128) >> 8) + 128) >> 8);
+		t = b * inv;
+		b = o[2] + ((t + ((t + 128) >> 8) + 128) >> 8);
+		if(r > 255)r = 255;
+		if(g > 255)g = 255;
+		if(b > 255)b = 255;
+		dst[x] = ((r >> 3) << 11) | ((g >> 2) << 5) | b >> 3;
+	}
+}
+
+void tftglTerminateLayers(){
+	if(layerFbo != 0)glDeleteFramebuffers(1, &layerFbo);
+	if(layerTex != 0)glDeleteTextures(1, &layerTex);
+	if(layerStencil != 0)glDeleteRenderbuffers(1, &layerStencil);
+	layerFbo = layerTex = layerStencil = 0;
+	free(layerBackground);
+	free(layerRead);
+	free(layerOut);
+	layerBackground = layerOut = NULL;
+	layerRead = NULL;
+}
+
+// Buffers for the rectangles, large enough for the entire screen
+static unsigned int tftglLayerBuffers(){
+	if(layerRead == NULL)layerRead = malloc(LCD_WIDTH * LCD_HEIGHT * 4);
+	if(layerOut == NULL)layerOut = malloc(LCD_WIDTH * LCD_HEIGHT * sizeof(unsigned short));
+	if(layerRead == NULL || layerOut == NULL){
+		errorCode = TFTGL_OUT_OF_MEM;
+		return TFTGL_ERROR;
+	}
+	return TFTGL_OK;
+}
+
+unsigned int tftglCacheBackground(){
+	unsigned int x, y;
+
+	if(tftglLayerBuffers() != TFTGL_OK)return TFTGL_ERROR;
+	if(layerBackground == NULL){
+		layerBackground = malloc(LCD_WIDTH * LCD_HEIGHT * sizeof(unsigned short));
+		if(layerBackground == NULL){
+			errorCode = TFTGL_OUT_OF_MEM;
+			return TFTGL_ERROR;
+		}
+	}
+
+	// GL rows are bottom to top
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glReadPixels(0, 0, LCD_WIDTH, LCD_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, layerRead);
+	for(y = 0; y < LCD_HEIGHT; y++){
+		const unsigned char* src = &layerRead[(LCD_HEIGHT - 1 - y) * LCD_WIDTH * 4];
+		unsigned short* dst = &layerBackground[y * LCD_WIDTH];
+		for(x = 0; x < LCD_WIDTH; x++){
+			dst[x] = ((src[0] >> 3) << 11) | ((src[1] >> 2) << 5) | src[2] >> 3;
+			src += 4;
+		}
+	}
+	return TFTGL_OK;
+}
+
+unsigned int tftglBeginOverlay(){
+	if(layerFbo == 0){
+		GLint prevTex, prevRenderbuffer;
+		GLenum result;
+
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &prevTex);
+		glGetIntegerv(GL_RENDERBUFFER_BINDING, &prevRenderbuffer);
+
+		glGenTextures(1, &layerTex);
+		glBindTexture(GL_TEXTURE_2D, layerTex);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, LCD_WIDTH, LCD_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		// nanovg fills shapes with the stencil buffer
+		glGenRenderbuffers(1, &layerStencil);
+		glBindRenderbuffer(GL_RENDERBUFFER, layerStencil);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_STENCIL_INDEX8, LCD_WIDTH, LCD_HEIGHT);
+
+		glGenFramebuffers(1, &layerFbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, layerFbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, layerTex, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, layerStencil);
+		result = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+		glBindTexture(GL_TEXTURE_2D, prevTex);
+		glBindRenderbuffer(GL_RENDERBUFFER, prevRenderbuffer);
+
+		if(result != GL_FRAMEBUFFER_COMPLETE){
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glDeleteFramebuffers(1, &layerFbo);
+			glDeleteTextures(1, &layerTex);
+			glDeleteRenderbuffers(1, &layerStencil);
+			layerFbo = layerTex = layerStencil = 0;
+			errorCode = TFTGL_BAD_SURFACE;
+			return TFTGL_ERROR;
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, layerFbo);
+	glViewport(0, 0, LCD_WIDTH, LCD_HEIGHT);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	return TFTGL_OK;
+}
+
+void tftglUploadOverlay(){
+	unsigned int i, y;
+
+	if(layerFbo == 0 || layerBackground == NULL){
+		dirtyCount = 0;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return;
+	}
+
+	// The display bus can not be shared with the upload thread
+	tftglWaitUpload();
+	glBindFramebuffer(GL_FRAMEBUFFER, layerFbo);
+
+	for(i = 0; i < dirtyCount; i++){
+		unsigned int x = dirtyRects[i].x;
+		unsigned int top = dirtyRects[i].y;
+		unsigned int w = dirtyRects[i].w;
+		unsigned int h = dirtyRects[i].h;
+		unsigned long start;
+
+		if(x >= LCD_WIDTH || top >= LCD_HEIGHT || w == 0 || h == 0)continue;
+		if(x + w > LCD_WIDTH)w = LCD_WIDTH - x;
+		if(top + h > LCD_HEIGHT)h = LCD_HEIGHT - top;
+
+		start = tftglMicros();
+		STATS_ADD(uploads, 1);
+		glReadPixels(x, LCD_HEIGHT - top - h, w, h, GL_RGBA, GL_UNSIGNED_BYTE, layerRead);
+		STATS_ADD(readMicros, tftglMicros() - start);
+
+		// Blended top to bottom, the overlay rows are bottom to top
+		for(y = 0; y < h; y++){
+			tftglLayerBlendRow(&layerOut[y * w], &layerBackground[(top + y) * LCD_WIDTH + x],
+				&layerRead[(h - 1 - y) * w * 4], w);
+		}
+
+		// The rects are one frame for the frame pacing and tear sync
+		frameContinued = (i > 0);
+		tftglWaitFrame(x, top, w, h);
+		start = tftglMicros();
+		tftglDisplayPush565(x, top, w, h, layerOut, w);
+		STATS_ADD(pushMicros, tftglMicros() - start);
+		tftglInvalidateFrameDiff(x, top, w, h);
+	}
+	frameContinued = 0;
+	dirtyCount = 0;
+
+	tftglDisplayShow();
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
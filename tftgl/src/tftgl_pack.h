@@ -0,0 +1,223 @@
+// GPU side RGB-565 packing. The rendered frame is copied into a texture
+// and drawn into a half width framebuffer object, where every RGBA texel
+// holds two RGB-565 pixels (low byte first). Reading that back moves
+// two bytes per pixel instead of three and needs no CPU conversion.
+
+#define STRINGIFY(x) #x
+
+static const char* packVertexCode = STRINGIFY(
+	attribute vec2 pos;
+	void main() {
+		gl_Position = vec4(pos, 0.0, 1.0);
+	}
+);
+
+// Texel coordinates reach 799.5 on an 800 wide screen and 1599.5 with
+// TFTGL_DUAL_PANEL, mediump (as little as 10 bits of mantissa) is only
+// exact to half a texel up to 1024 and off by more above. The
+// preprocessor lines can not go through STRINGIFY.
+static const char* packFragmentCode =
+	"#ifdef GL_FRAGMENT_PRECISION_HIGH\n"
+	"precision highp float;\n"
+	"#else\n"
+	"precision mediump float;\n"
+	"#endif\n"
+	STRINGIFY(
+	uniform sampler2D scene;
+	uniform vec2 texelSize;
+	vec2 pack565(vec3 c) {
+		vec3 c8 = floor(c * 255.0 + 0.5);
+		float r = floor(c8.r / 8.0);
+		float g = floor(c8.g / 4.0);
+		float b = floor(c8.b / 8.0);
+		return vec2(mod(g, 8.0) * 32.0 + b, r * 8.0 + floor(g / 8.0));
+	}
+	void main() {
+		float x = floor(gl_FragCoord.x) * 2.0;
+		float y = gl_FragCoord.y;
+		vec2 first = pack565(texture2D(scene, vec2(x + 0.5, y) * texelSize).rgb);
+		vec2 second = pack565(texture2D(scene, vec2(x + 1.5, y) * texelSize).rgb);
+		gl_FragColor = vec4(first, second) / 255.0;
+	}
+);
+
+static const GLfloat packQuad[] = {
+	-1.0f, -1.0f,
+	 1.0f, -1.0f,
+	-1.0f,  1.0f,
+	 1.0f,  1.0f,
+};
+
+static unsigned int packEnabled = 0;
+static GLuint packProgram = 0;
+static GLuint packSceneTex = 0;
+static GLuint packTargetTex = 0;
+static GLuint packFbo = 0;
+static GLuint packVbo = 0;
+static GLint packPosLoc = -1;
+
+static GLuint tftglCompilePackShader(GLenum type, const char* code){
+	GLint result;
+	GLuint shader = glCreateShader(type);
+	if(shader == 0)return 0;
+	glShaderSource(shader, 1, &code, NULL);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
+	if(result == GL_FALSE){
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+void tftglTerminatePack(){
+	if(packProgram != 0)glDeleteProgram(packProgram);
+	if(packSceneTex != 0)glDeleteTextures(1, &packSceneTex);
+	if(packTargetTex != 0)glDeleteTextures(1, &packTargetTex);
+	if(packFbo != 0)glDeleteFramebuffers(1, &packFbo);
+	if(packVbo != 0)glDeleteBuffers(1, &packVbo);
+	packProgram = packSceneTex = packTargetTex = packFbo = packVbo = 0;
+	packEnabled = 0;
+}
+
+// Must be called with the EGL context current. If anything is not supported
+// packing stays disabled and uploads use the plain RGB-888 read.
+unsigned int tftglInitPack(unsigned int flags){
+	GLuint vert, frag;
+	GLint result, prevTex, prevFbo, prevBuffer;
+
+	if(!(flags & TFTGL_PACK_565))return TFTGL_OK;
+	// The packed texels must line up with pixel pairs of the screen
+	if(LCD_WIDTH % 2 != 0)return TFTGL_OK;
+
+	vert = tftglCompilePackShader(GL_VERTEX_SHADER, packVertexCode);
+	frag = tftglCompilePackShader(GL_FRAGMENT_SHADER, packFragmentCode);
+	if(vert == 0 || frag == 0){
+		if(vert != 0)glDeleteShader(vert);
+		if(frag != 0)glDeleteShader(frag);
+		return TFTGL_OK;
+	}
+	packProgram = glCreateProgram();
+	glAttachShader(packProgram, vert);
+	glAttachShader(packProgram, frag);
+	glLinkProgram(packProgram);
+	glDeleteShader(vert);
+	glDeleteShader(frag);
+	glGetProgramiv(packProgram, GL_LINK_STATUS, &result);
+	if(result == GL_FALSE){
+		tftglTerminatePack();
+		return TFTGL_OK;
+	}
+	packPosLoc = glGetAttribLocation(packProgram, "pos");
+
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &prevTex);
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFbo);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &prevBuffer);
+
+	// Copy of the rendered frame
+	glGenTextures(1, &packSceneTex);
+	glBindTexture(GL_TEXTURE_2D, packSceneTex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, LCD_WIDTH, LCD_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// Half width packed target
+	glGenTextures(1, &packTargetTex);
+	glBindTexture(GL_TEXTURE_2D, packTargetTex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, LCD_WIDTH / 2, LCD_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenFramebuffers(1, &packFbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, packFbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, packTargetTex, 0);
+	result = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	glGenBuffers(1, &packVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, packVbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(packQuad), packQuad, GL_STATIC_DRAW);
+
+	glBindTexture(GL_TEXTURE_2D, prevTex);
+	glBindFramebuffer(GL_FRAMEBUFFER, prevFbo);
+	glBindBuffer(GL_ARRAY_BUFFER, prevBuffer);
+
+	if(result != GL_FRAMEBUFFER_COMPLETE || glGetError() != GL_NO_ERROR){
+		tftglTerminatePack();
+		return TFTGL_OK;
+	}
+
+	packEnabled = 1;
+	return TFTGL_OK;
+}
+
+// Reads the area as bottom to top RGB-565 rows into buffer.
+// The x and w must be even! Returns TFTGL_ERROR (and disables packing)
+// if the GPU refused, in which case the caller should read RGB-888.
+static unsigned int tftglReadPacked(unsigned int x, unsigned int y, unsigned int w, unsigned int h,
+	unsigned short* buffer){
+	GLint prevProgram, prevTex, prevFbo, prevBuffer, prevActive;
+	GLint prevViewport[4];
+	GLboolean prevBlend, prevDepth, prevStencil, prevScissor;
+	unsigned int glY = LCD_HEIGHT - y - h;
+	unsigned int ok = TFTGL_OK;
+
+	glGetIntegerv(GL_CURRENT_PROGRAM, &prevProgram);
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &prevActive);
+	glActiveTexture(GL_TEXTURE0);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &prevTex);
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFbo);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &prevBuffer);
+	glGetIntegerv(GL_VIEWPORT, prevViewport);
+	prevBlend = glIsEnabled(GL_BLEND);
+	prevDepth = glIsEnabled(GL_DEPTH_TEST);
+	prevStencil = glIsEnabled(GL_STENCIL_TEST);
+	prevScissor = glIsEnabled(GL_SCISSOR_TEST);
+
+	// Copy the area of the rendered frame
+	glGetError();
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, packSceneTex);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, x, glY, x, glY, w, h);
+	if(glGetError() != GL_NO_ERROR){
+		// For example multisampled buffers can not be copied
+		ok = TFTGL_ERROR;
+	} else {
+		glBindFramebuffer(GL_FRAMEBUFFER, packFbo);
+		glViewport(x / 2, glY, w / 2, h);
+		glDisable(GL_BLEND);
+		glDisable(GL_DEPTH_TEST);
+		glDisable(GL_STENCIL_TEST);
+		glDisable(GL_SCISSOR_TEST);
+
+		glUseProgram(packProgram);
+		glUniform1i(glGetUniformLocation(packProgram, "scene"), 0);
+		glUniform2f(glGetUniformLocation(packProgram, "texelSize"), 1.0f / LCD_WIDTH, 1.0f / LCD_HEIGHT);
+		glBindBuffer(GL_ARRAY_BUFFER, packVbo);
+		glEnableVertexAttribArray(packPosLoc);
+		glVertexAttribPointer(packPosLoc, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		glDisableVertexAttribArray(packPosLoc);
+
+		glReadPixels(x / 2, glY, w / 2, h, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
+	}
+
+	glUseProgram(prevProgram);
+	glBindTexture(GL_TEXTURE_2D, prevTex);
+	glActiveTexture(prevActive);
+	glBindFramebuffer(GL_FRAMEBUFFER, prevFbo);
+	glBindBuffer(GL_ARRAY_BUFFER, prevBuffer);
+	glViewport(prevViewport[0], prevViewport[1], prevViewport[2], prevViewport[3]);
+	if(prevBlend)glEnable(GL_BLEND);
+	if(prevDepth)glEnable(GL_DEPTH_TEST);
+	if(prevStencil)glEnable(GL_STENCIL_TEST);
+	if(prevScissor)glEnable(GL_SCISSOR_TEST);
+
+	if(ok != TFTGL_OK){
+		tftglTerminatePack();
+	}
+	return ok;
+}
@@ -0,0 +1,196 @@
+// Software simulator of the Raspberry Pi GPIO and SPI used instead of
+// the bcm2835 library (build with make BACKEND=sim). GPIO register writes
+// are decoded into pin levels and handed to the emulated display in
+// tftgl_sim_display.h, SPI transfers are answered by an emulated ADS7843
+// with scripted touch samples. Nothing here touches real hardware.
+
+#include <fcntl.h>
+#include <linux/gpio.h>
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define BCM2835_GPSET0 0x001c
+#define BCM2835_GPCLR0 0x0028
+#define BCM2835_GPLEV0 0x0034
+#define BCM2835_REGBASE_GPIO 2
+#define BCM2835_GPIO_FSEL_INPT 0x00
+#define BCM2835_GPIO_FSEL_OUTP 0x01
+#define BCM2835_SPI_CS0 0
+#define BCM2835_SPI_CLOCK_DIVIDER_4096 4096
+
+// Register file, gpioData points here
+static uint32_t simRegs[64];
+// Current level of every GPIO pin
+static uint32_t simLevels = 0;
+static TftglSimStats simStats;
+
+// Implemented by the emulated display, called on every change of pin levels
+static void tftglSimGpioChanged(uint32_t oldLevels, uint32_t newLevels);
+// Implemented by the emulated display, adds the levels of its output pins
+static uint32_t tftglSimReadReg(unsigned int reg);
+// Implemented by the emulated display, emulates the controller of a driver
+static void tftglSimSetController(unsigned int id);
+
+static void tftglSimWriteReg(unsigned int reg, uint32_t value){
+	uint32_t old = simLevels;
+	simRegs[reg] = value;
+	simStats.gpioWrites++;
+	if(reg == BCM2835_GPSET0 / 4){
+		simLevels |= value;
+	} else if(reg == BCM2835_GPCLR0 / 4){
+		simLevels &= ~value;
+	}
+	simRegs[BCM2835_GPLEV0 / 4] = simLevels;
+	if(old != simLevels){
+		tftglSimGpioChanged(old, simLevels);
+	}
+}
+
+static int bcm2835_init(){
+	memset(simRegs, 0, sizeof(simRegs));
+	simLevels = 0;
+	return 1;
+}
+
+static int bcm2835_close(){
+	return 1;
+}
+
+static volatile uint32_t* bcm2835_regbase(uint8_t regbase){
+	(void)regbase;
+	return simRegs;
+}
+
+static void bcm2835_gpio_fsel(uint8_t pin, uint8_t mode){
+	(void)pin;
+	(void)mode;
+}
+
+// Emulated ADS7843. The touch script is a list of raw readings, each
+// one held for the given number of conversions.
+static TftglSimTouch simTouchFixed = {0, 0, 0, 0};
+static const TftglSimTouch* simTouchScript = NULL;
+static unsigned int simTouchCount = 0;
+static unsigned int simTouchIndex = 0;
+static unsigned int simTouchConversions = 0;
+
+static const TftglSimTouch* tftglSimCurrentTouch(){
+	if(simTouchScript == NULL)return &simTouchFixed;
+	if(simTouchIndex >= simTouchCount)return &simTouchFixed;
+	return &simTouchScript[simTouchIndex];
+}
+
+// Emulated PENIRQ line, a pipe of the edge events the GPIO character
+// device would give. Falls when the pen goes down (Z above zero).
+static int simLineEvents[2] = {-1, -1};
+static unsigned int simPenDown = 0;
+
+static int tftglSimOpenLineEvent(unsigned int pin){
+	(void)pin;
+	if(simLineEvents[0] < 0){
+		if(pipe2(simLineEvents, O_CLOEXEC | O_NONBLOCK) != 0)return -1;
+	}
+	// The caller owns the read end, dup so it can close it
+	return fcntl(simLineEvents[0], F_DUPFD_CLOEXEC, 0);
+}
+
+// Level of the emulated PENIRQ line, low while the pen is down
+static unsigned int tftglSimReadLine(int fd){
+	(void)fd;
+	return !simPenDown;
+}
+
+static void tftglSimPenChanged(){
+	unsigned int down = tftglSimCurrentTouch()->z > 0;
+	unsigned int fell = down && !simPenDown;
+
+	// The level first, a woken sampler reads it
+	simPenDown = down;
+	if(fell && simLineEvents[1] >= 0){
+		struct gpioevent_data edge;
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		edge.timestamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+		edge.id = GPIOEVENT_EVENT_FALLING_EDGE;
+		if(write(simLineEvents[1], &edge, sizeof(edge)) < 0){
+			// Full pipe, there are edges to wake up already
+		}
+	}
+}
+
+static unsigned int tftglSimConvert(unsigned char control){
+	const TftglSimTouch* touch = tftglSimCurrentTouch();
+	unsigned int value;
+
+	switch(control & 0x70){
+		case (0x5 << 4): value = touch->x; break;
+		case (0x1 << 4): value = touch->y; break;
+		case (0x3 << 4): value = touch->z; break;
+		case (0x4 << 4): value = (touch->z > 0 ? 4095 - touch->z : 4095); break;
+		default: value = 0; break;
+	}
+
+	simStats.conversions++;
+	if(simTouchScript != NULL && simTouchIndex < simTouchCount){
+		if(++simTouchConversions >= simTouchScript[simTouchIndex].conversions){
+			simTouchConversions = 0;
+			simTouchIndex++;
+			tftglSimPenChanged();
+		}
+	}
+	return value & 0xFFF;
+}
+
+static int bcm2835_spi_begin(){
+	return 1;
+}
+
+static void bcm2835_spi_end(){
+}
+
+static void bcm2835_spi_setClockDivider(uint16_t divider){
+	(void)divider;
+}
+
+static void bcm2835_spi_chipSelect(uint8_t cs){
+	(void)cs;
+}
+
+// A control byte (start bit set) starts a conversion, the 12-bit result
+// is clocked out MSB first one clock after the control byte ends.
+static void bcm2835_spi_transfernb(char* tbuf, char* rbuf, uint32_t len){
+	uint32_t i;
+	memset(rbuf, 0, len);
+	for(i = 0; i < len; i++){
+		unsigned char control = (unsigned char)tbuf[i];
+		if(control & 0x80){
+			unsigned int value = tftglSimConvert(control);
+			if(i + 1 < len)rbuf[i + 1] |= (char)(value >> 5);
+			if(i + 2 < len)rbuf[i + 2] |= (char)((value << 3) & 0xFF);
+		}
+	}
+}
+
+void tftglSimSetTouch(unsigned int x, unsigned int y, unsigned int z){
+	simTouchFixed.x = x;
+	simTouchFixed.y = y;
+	simTouchFixed.z = z;
+	simTouchScript = NULL;
+	tftglSimPenChanged();
+}
+
+void tftglSimSetTouchScript(const TftglSimTouch* script, unsigned int count){
+	simTouchScript = script;
+	simTouchCount = count;
+	simTouchIndex = 0;
+	simTouchConversions = 0;
+	tftglSimPenChanged();
+}
+
+void tftglSimGetStats(TftglSimStats* dst){
+	if(dst != NULL){
+		*dst = simStats;
+	}
+	memset(&simStats, 0, sizeof(TftglSimStats));
+}
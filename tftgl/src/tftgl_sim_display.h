@@ -0,0 +1,292 @@
+// Emulated LCD controllers for the simulator backend. Decodes WR pulses on
+// the GPIO pins defined in tftgl_display.h into commands and data, and
+// keeps the frame memory of the controller (RGB-565). The controller is
+// the one of the driver selected by tftglInit. Two panels are emulated,
+// each takes the bus writes while its chip select (LCD_CS, LCD_CS2) is low.
+
+#define SIM_MAX_WIDTH 800
+#define SIM_MAX_HEIGHT 480
+
+// What differs between the emulated controllers
+typedef struct {
+	unsigned int width, height; // Frame memory, the height is the scan lines
+	unsigned int bus8; // 8-bit bus, pixels are two writes (high byte first)
+	unsigned int dcs; // Sleeps after reset, pixel format 0x3A, BGR panel
+	unsigned int lines; // Scan lines of a frame
+	unsigned int lineNs; // Duration of a scan line
+} TftglSimController;
+
+// Indexed by the TFTGL_DRIVER_ flag. The SSD1963 timing is set by its
+// init table: 525 lines (480 visible) of 928 pixel clocks at 34.3 MHz.
+static const TftglSimController simControllers[4] = {
+	{800, 480, 0, 0, 525, 27030}, // SSD1963, 70 Hz
+	{240, 320, 1, 1, 324, 44090}, // ILI9341, 70 Hz
+	{320, 480, 0, 1, 484, 34440}, // ILI9486, 60 Hz
+	{320, 480, 0, 1, 484, 34440}, // ST7796, 60 Hz
+};
+static const TftglSimController* simController = &simControllers[0];
+
+// State of one emulated controller
+typedef struct {
+	unsigned short memory[SIM_MAX_WIDTH * SIM_MAX_HEIGHT];
+	unsigned int command;
+	unsigned int param;
+	unsigned int params[16];
+	unsigned int columnStart, columnEnd;
+	unsigned int pageStart, pageEnd;
+	unsigned int column, page;
+	unsigned int addressMode;
+	unsigned int scrollTop, scrollHeight, scrollStart;
+	unsigned int tearEnabled;
+	unsigned int displayOn;
+	unsigned int sleeping;
+	unsigned int pixelFormat; // Pixels are written only in RGB-565
+	unsigned int highByte, highBytePending;
+} TftglSimPanel;
+
+#define SIM_PANELS 2
+static const unsigned int simPanelCs[SIM_PANELS] = {LCD_CS, LCD_CS2};
+static TftglSimPanel simPanels[SIM_PANELS];
+// The panel as it is seen, see tftglSimGetPanel
+static unsigned short simPanelView[SIM_MAX_WIDTH * SIM_MAX_HEIGHT];
+
+static unsigned int tftglSimBusValue(uint32_t levels){
+	unsigned int i, value = 0;
+	for(i = 0; i < 16; i++){
+		if(levels & (1 << busPins[i]))value |= (1 << i);
+	}
+	return value;
+}
+
+// Writes one pixel at the write pointer and moves it, the address mode
+// (command 0x36) decides how window addresses map to frame memory
+static void tftglSimMemoryWrite(TftglSimPanel* sp, unsigned int color){
+	unsigned int column = sp->column;
+	unsigned int page = sp->page;
+
+	if(sp->addressMode & 0x40)column = simController->width - 1 - column;
+	if(sp->addressMode & 0x80)page = simController->height - 1 - page;
+	if(column < simController->width && page < simController->height && sp->pixelFormat){
+		sp->memory[page * simController->width + column] = color;
+	}
+
+	// Page/column exchange walks the window page first
+	if(sp->addressMode & 0x20){
+		if(sp->page++ >= sp->pageEnd){
+			sp->page = sp->pageStart;
+			if(sp->column++ >= sp->columnEnd)sp->column = sp->columnStart;
+		}
+	} else {
+		if(sp->column++ >= sp->columnEnd){
+			sp->column = sp->columnStart;
+			if(sp->page++ >= sp->pageEnd)sp->page = sp->pageStart;
+		}
+	}
+}
+
+// Software and hardware reset, the frame memory is kept
+static void tftglSimReset(TftglSimPanel* sp){
+	sp->displayOn = 0;
+	sp->sleeping = simController->dcs;
+	sp->pixelFormat = 0;
+	sp->tearEnabled = 0;
+	sp->addressMode = 0;
+	sp->scrollTop = sp->scrollStart = 0;
+	sp->scrollHeight = simController->height;
+}
+
+static void tftglSimSetController(unsigned int id){
+	unsigned int i;
+	simController = &simControllers[(id & TFTGL_DRIVER_MASK) / TFTGL_DRIVER_ILI9341];
+	for(i = 0; i < SIM_PANELS; i++){
+		TftglSimPanel* sp = &simPanels[i];
+		sp->columnEnd = simController->width - 1;
+		sp->pageEnd = simController->height - 1;
+		tftglSimReset(sp);
+	}
+}
+
+static void tftglSimCommand(TftglSimPanel* sp, unsigned int command){
+	sp->command = command;
+	sp->param = 0;
+	sp->highBytePending = 0;
+	if(command == 0x2C){
+		// Write memory start
+		sp->column = sp->columnStart;
+		sp->page = sp->pageStart;
+	} else if(command == 0x34){
+		sp->tearEnabled = 0;
+	} else if(command == 0x28){
+		sp->displayOn = 0;
+	} else if(command == 0x29){
+		sp->displayOn = 1;
+	} else if(command == 0x10 && simController->dcs){
+		sp->sleeping = 1;
+	} else if(command == 0x11 && simController->dcs){
+		sp->sleeping = 0;
+	} else if(command == 0x01){
+		tftglSimReset(sp);
+	}
+}
+
+static void tftglSimData(TftglSimPanel* sp, unsigned int value){
+	if(sp->command == 0x2C || sp->command == 0x3C){
+		if(!simController->bus8){
+			tftglSimMemoryWrite(sp, value);
+		} else if(sp->highBytePending){
+			tftglSimMemoryWrite(sp, (sp->highByte << 8) | (value & 0xFF));
+			sp->highBytePending = 0;
+		} else {
+			sp->highByte = value & 0xFF;
+			sp->highBytePending = 1;
+		}
+		return;
+	}
+
+	if(sp->param < 16){
+		sp->params[sp->param] = value & 0xFF;
+	}
+	sp->param++;
+
+	switch(sp->command){
+		case 0x2A:
+			if(sp->param == 4){
+				sp->columnStart = (sp->params[0] << 8) | sp->params[1];
+				sp->columnEnd = (sp->params[2] << 8) | sp->params[3];
+			}
+			break;
+		case 0x2B:
+			if(sp->param == 4){
+				sp->pageStart = (sp->params[0] << 8) | sp->params[1];
+				sp->pageEnd = (sp->params[2] << 8) | sp->params[3];
+			}
+			break;
+		case 0x36:
+			if(sp->param == 1){
+				sp->addressMode = sp->params[0];
+			}
+			break;
+		case 0x33:
+			// Scroll area, the bottom fixed area is the rest
+			if(sp->param == 6){
+				sp->scrollTop = (sp->params[0] << 8) | sp->params[1];
+				sp->scrollHeight = (sp->params[2] << 8) | sp->params[3];
+			}
+			break;
+		case 0x35:
+			if(sp->param == 1){
+				sp->tearEnabled = 1;
+			}
+			break;
+		case 0x37:
+			if(sp->param == 2){
+				sp->scrollStart = (sp->params[0] << 8) | sp->params[1];
+			}
+			break;
+		case 0x3A:
+			// MIPI pixel format, 16 bits per pixel on the MCU interface
+			if(sp->param == 1 && simController->dcs){
+				sp->pixelFormat = ((sp->params[0] & 0x07) == 0x05);
+			}
+			break;
+		case 0xF0:
+			// SSD1963 pixel data interface, 16-bit 565
+			if(sp->param == 1 && !simController->dcs){
+				sp->pixelFormat = (sp->params[0] == 0x03);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+// The TE pin is high during the vertical blank of the virtual scan clock,
+// it is the one of the first panel
+static uint32_t tftglSimReadReg(unsigned int reg){
+	uint32_t value = simRegs[reg];
+	if(reg == BCM2835_GPLEV0 / 4 && simPanels[0].tearEnabled){
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		unsigned long long ns = (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+		unsigned int line = (ns / simController->lineNs) % simController->lines;
+		if(line >= simController->height){
+			value |= (1 << LCD_TE);
+		} else {
+			value &= ~(1 << LCD_TE);
+		}
+	}
+	return value;
+}
+
+static void tftglSimGpioChanged(uint32_t oldLevels, uint32_t newLevels){
+	unsigned int i;
+	// The panels share the reset line
+	if((oldLevels & (1 << LCD_RESET)) && !(newLevels & (1 << LCD_RESET))){
+		for(i = 0; i < SIM_PANELS; i++){
+			tftglSimReset(&simPanels[i]);
+		}
+	}
+	// The selected controllers latch D0 to D15 (D0 to D7) on the rising edge of WR
+	if(!(oldLevels & (1 << LCD_WR)) && (newLevels & (1 << LCD_WR))){
+		unsigned int value = tftglSimBusValue(newLevels);
+		if(simController->bus8)value &= 0xFF;
+		simStats.wrPulses++;
+		if(!(newLevels & (1 << LCD_RS))){
+			simStats.commands++;
+		}
+		for(i = 0; i < SIM_PANELS; i++){
+			if(newLevels & (1 << simPanelCs[i]))continue;
+			if(newLevels & (1 << LCD_RS)){
+				tftglSimData(&simPanels[i], value);
+			} else {
+				tftglSimCommand(&simPanels[i], value & 0xFF);
+			}
+		}
+	}
+}
+
+// Returns the panel as it is seen, RGB-565 top to bottom in the size
+// returned by tftglSimGetPanelSize. The SSD1963 flips the scan with the
+// bits A0 and A1 of the address mode, its panel is mounted so that
+// landscape mode (both flips) shows frame memory as it is. The other
+// panels show frame memory as it is, with red and blue swapped (BGR) if
+// the address mode does not set the BGR bit. Lines of the scroll area
+// are read starting from the scroll start line. The panel is black while
+// the display is off or sleeping. With TFTGL_DUAL_PANEL the first panel
+// shows the left half of the screen, see tftglSimGetPanelAt.
+const unsigned short* tftglSimGetPanel(){
+	return tftglSimGetPanelAt(0);
+}
+
+// Same as tftglSimGetPanel for the panel with the given chip select (0 for
+// LCD_CS, 1 for LCD_CS2). The returned buffer is reused by the next call.
+const unsigned short* tftglSimGetPanelAt(unsigned int index){
+	unsigned int x, y;
+	unsigned int width = simController->width;
+	unsigned int height = simController->height;
+	const TftglSimPanel* sp = &simPanels[index < SIM_PANELS ? index : 0];
+	if(!sp->displayOn || sp->sleeping){
+		memset(simPanelView, 0, sizeof(simPanelView));
+		return simPanelView;
+	}
+	for(y = 0; y < height; y++){
+		unsigned int my = (simController->dcs || (sp->addressMode & 0x01)) ? y : height - 1 - y;
+		if(my >= sp->scrollTop && my < sp->scrollTop + sp->scrollHeight && sp->scrollStart >= sp->scrollTop){
+			my = sp->scrollTop + (my - sp->scrollTop + sp->scrollStart - sp->scrollTop) % sp->scrollHeight;
+		}
+		for(x = 0; x < width; x++){
+			unsigned int mx = (simController->dcs || (sp->addressMode & 0x02)) ? x : width - 1 - x;
+			unsigned short color = sp->memory[my * width + mx];
+			if(simController->dcs && !(sp->addressMode & 0x08)){
+				color = (color >> 11) | (color & 0x07E0) | (color << 11);
+			}
+			simPanelView[y * width + x] = color;
+		}
+	}
+	return simPanelView;
+}
+
+void tftglSimGetPanelSize(unsigned int* width, unsigned int* height){
+	if(width != NULL)*width = simController->width;
+	if(height != NULL)*height = simController->height;
+}
@@ -0,0 +1,171 @@
+// Sprites: images converted to RGB-565 once and sent straight to the LCD,
+// without going through OpenGL. Images with transparent pixels are split
+// into rectangles of opaque pixels when loaded, only those are sent.
+
+// The bundled stb_image of nanovg, a private copy so it does not clash
+// with the one in libnanovg. STB_IMAGE_STATIC misses one function of this
+// version, which is renamed. Without HDR images, which would need -lm.
+#define STB_IMAGE_STATIC
+#define stbi__tga_read_rgb16 tftgl_stbi__tga_read_rgb16
+#define STBI_NO_HDR
+#define STBI_NO_LINEAR
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// Pixels with a lower alpha are transparent
+#define SPRITE_ALPHA_KEY 128
+
+// Splits the opaque pixels into rectangles. Each row is split into runs of
+// opaque pixels, a run with the same columns as a rectangle that ends on
+// the row above makes it one row taller. Returns the number of rectangles.
+static unsigned int tftglSpriteSplit(TftglSprite* sprite, const unsigned char* rgba, unsigned int* open){
+	unsigned int y, w = sprite->width;
+	unsigned int count = 0, maxRuns = (w + 1) / 2;
+	// Rectangles that end on the row above and on this row, left to right
+	unsigned int* prev = open;
+	unsigned int* next = open + maxRuns;
+	unsigned int prevCount = 0;
+
+	for(y = 0; y < sprite->height; y++){
+		const unsigned char* row = &rgba[y * w * 4];
+		unsigned int x = 0, o = 0, nextCount = 0;
+		unsigned int* t;
+
+		while(x < w){
+			unsigned int start;
+			while(x < w && row[x * 4 + 3] < SPRITE_ALPHA_KEY)x++;
+			if(x == w)break;
+			start = x;
+			while(x < w && row[x * 4 + 3] >= SPRITE_ALPHA_KEY)x++;
+
+			while(o < prevCount && sprite->spans[prev[o]].x < start)o++;
+			if(o < prevCount && sprite->spans[prev[o]].x == start && sprite->spans[prev[o]].w == x - start){
+				sprite->spans[prev[o]].h++;
+				next[nextCount++] = prev[o++];
+			} else {
+				TftglRect* span = &sprite->spans[count];
+				span->x = start;
+				span->y = y;
+				span->w = x - start;
+				span->h = 1;
+				next[nextCount++] = count++;
+			}
+		}
+
+		t = prev;
+		prev = next;
+		next = t;
+		prevCount = nextCount;
+	}
+	return count;
+}
+
+TftglSprite* tftglCreateSprite(const unsigned char* rgba, unsigned int w, unsigned int h, unsigned int keyed){
+	unsigned int i;
+	unsigned int* open;
+	TftglSprite* sprite;
+
+	if(w == 0 || h == 0){
+		errorCode = TFTGL_BAD_IMAGE;
+		return NULL;
+	}
+
+	sprite = calloc(1, sizeof(TftglSprite));
+	if(sprite == NULL){
+		errorCode = TFTGL_OUT_OF_MEM;
+		return NULL;
+	}
+	sprite->width = w;
+	sprite->height = h;
+	sprite->pixels = malloc(w * h * sizeof(unsigned short));
+	// At most a rectangle for every other pixel of a row
+	sprite->spans = malloc((keyed ? (w + 1) / 2 * h : 1) * sizeof(TftglRect));
+	if(sprite->pixels == NULL || sprite->spans == NULL){
+		tftglFreeSprite(sprite);
+		errorCode = TFTGL_OUT_OF_MEM;
+		return NULL;
+	}
+
+	// Convert RGBA-8888 to RGB-565
+	for(i = 0; i < w * h; i++){
+		const unsigned char* p = &rgba[i * 4];
+		sprite->pixels[i] = ((p[0] >> 3) << 11) | ((p[1] >> 2) << 5) | p[2] >> 3;
+	}
+
+	if(!keyed){
+		sprite->spans[0].x = sprite->spans[0].y = 0;
+		sprite->spans[0].w = w;
+		sprite->spans[0].h = h;
+		sprite->spanCount = 1;
+		return sprite;
+	}
+
+	open = malloc((w + 1) / 2 * 2 * sizeof(unsigned int));
+	if(open == NULL){
+		tftglFreeSprite(sprite);
+		errorCode = TFTGL_OUT_OF_MEM;
+		return NULL;
+	}
+	sprite->spanCount = tftglSpriteSplit(sprite, rgba, open);
+	free(open);
+
+	// Give back what was not needed
+	if(sprite->spanCount > 0){
+		TftglRect* spans = realloc(sprite->spans, sprite->spanCount * sizeof(TftglRect));
+		if(spans != NULL)sprite->spans = spans;
+	}
+	return sprite;
+}
+
+TftglSprite* tftglLoadSprite(const char* filename, unsigned int keyed){
+	int w, h, channels;
+	TftglSprite* sprite;
+	unsigned char* rgba = stbi_load(filename, &w, &h, &channels, 4);
+
+	if(rgba == NULL){
+		errorCode = TFTGL_BAD_IMAGE;
+		return NULL;
+	}
+	sprite = tftglCreateSprite(rgba, w, h, keyed);
+	stbi_image_free(rgba);
+	return sprite;
+}
+
+void tftglFreeSprite(TftglSprite* sprite){
+	if(sprite == NULL)return;
+	free(sprite->pixels);
+	free(sprite->spans);
+	free(sprite);
+}
+
+void tftglDrawSprite(const TftglSprite* sprite, unsigned int x, unsigned int y){
+	unsigned int i;
+
+	if(sprite == NULL || displayInitialized == TFTGL_ERROR)return;
+	if(x >= LCD_WIDTH || y >= LCD_HEIGHT)return;
+
+	// The bus is shared with the upload thread
+	tftglWaitUpload();
+
+	for(i = 0; i < sprite->spanCount; i++){
+		const TftglRect* span = &sprite->spans[i];
+		unsigned int sx = x + span->x;
+		unsigned int sy = y + span->y;
+		unsigned int w = span->w;
+		unsigned int h = span->h;
+
+		// Check area dimensions
+		if(sx >= LCD_WIDTH || sy >= LCD_HEIGHT)continue;
+		if(sx + w > LCD_WIDTH){
+			w = LCD_WIDTH - sx;
+		}
+		if(sy + h > LCD_HEIGHT){
+			h = LCD_HEIGHT - sy;
+		}
+
+		tftglDisplayPush565(sx, sy, w, h, &sprite->pixels[span->y * sprite->width + span->x], sprite->width);
+		tftglInvalidateFrameDiff(sx, sy, w, h);
+	}
+
+	tftglDisplayShow();
+}
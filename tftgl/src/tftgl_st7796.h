@@ -0,0 +1,56 @@
+// ST7796 driver, 320x480 panel on a 16-bit bus. The frame is 480 lines
+// and 4 lines of porches at about 60 Hz. The vendor commands are locked
+// by command 0xF0 and only opened for the init.
+
+// Power up, only needed after a reset. Sleep out follows the software
+// reset directly, so that one waits the 120 ms the ST7796 needs after any
+// reset before sleep out. The vendor commands need 5 ms after sleep out.
+static const TftglInitCommand st7796InitPower[] = {
+	{0x01, 0, {0}, 120000},	// Software reset
+	{0x11, 0, {0}, 5000},	// Sleep out
+	{0xF0, 1, {0xC3}, 0},	// Command set control, enable part 1
+	{0xF0, 1, {0x96}, 0},	// Command set control, enable part 2
+	{0xB4, 1, {0x01}, 0},	// Display inversion control, 1-dot
+	{0xB6, 3, {0x80, 0x02, 0x3B}, 0},	// Display function control
+	{0xE8, 8, {0x40, 0x8A, 0x00, 0x00, 0x29, 0x19, 0xA5, 0x33}, 0},	// Display output ctrl adjust
+	{0xC1, 1, {0x06}, 0},	// Power control 2
+	{0xC2, 1, {0xA7}, 0},	// Power control 3
+	{0xC5, 1, {0x18}, 0},	// VCOM control
+	{0xE0, 14, {0xF0, 0x09, 0x0B, 0x06, 0x04, 0x15, 0x2F, 0x54, 0x42, 0x3C, 0x17, 0x14, 0x18, 0x1B}, 0},	// Positive gamma
+	{0xE1, 14, {0xE0, 0x09, 0x0B, 0x06, 0x04, 0x03, 0x2B, 0x43, 0x42, 0x3B, 0x16, 0x14, 0x17, 0x1B}, 0},	// Negative gamma
+	{0xF0, 1, {0x3C}, 0},	// Command set control, disable part 1
+	{0xF0, 1, {0x69}, 0},	// Command set control, disable part 2
+	{0x53, 1, {0x24}, 0},	// Brightness control on
+	{0x51, 1, {0x00}, 0},	// Initial brightness to 0%
+};
+
+// Interface, needs no waits. Also sets everything a warm start may find
+// changed back to the reset defaults.
+static const TftglInitCommand st7796InitPanel[] = {
+	{0x3A, 1, {0x55}, 0},	// Pixel format, 16-bit 565
+	{0x33, 6, {0x00, 0x00, 0x01, 0xE0, 0x00, 0x00}, 0},	// Scroll area, all of the screen
+	{0x37, 2, {0x00, 0x00}, 0},	// Scroll start
+	{0x34, 0, {0}, 0},	// Tear effect off
+};
+
+static void tftglSt7796Init(unsigned int warm){
+	if(!warm){
+		tftglDisplayRunTable(INIT_TABLE(st7796InitPower));
+	}
+	tftglDisplayRunTable(INIT_TABLE(st7796InitPanel));
+}
+
+// The panel is BGR, all address modes set the BGR bit (0x08)
+static const TftglDriver st7796Driver = {
+	TFTGL_DRIVER_ST7796,
+	320, 480, 484, 0,
+	{0x68, 0xA8, 0x08, 0xC8},
+	tftglSt7796Init,
+	tftglDcsSetWindow,
+	tftglBus16Write888,
+	tftglBus16Write565,
+	tftglBus16Fill,
+	tftglDcsBrightness,
+	tftglDcsSetScrollArea,
+	tftglDcsSetScrollStart
+};
@@ -0,0 +1,193 @@
+// Tear effect synchronized uploads and frame pacing. With TFTGL_TEAR_SYNC
+// the LCD outputs the vertical blank on its TE pin (command 0x35), and
+// pushes are started right after it, so a full frame is sent from the top
+// while the scan starts over. Partial updates that can not be sent before
+// the scan reaches them wait until the scan has passed them instead.
+
+// Lines of the display scan, set by the driver. The lines from LCD_VDP
+// to LCD_VT are the vertical blank.
+#define LCD_VT (displayDriver->lines)
+#define LCD_VDP (displayDriver->height)
+
+// Wake up this long before the predicted edge and poll the rest (us)
+#define TEAR_SPIN 300
+// Give up waiting for an edge after this long (us)
+#define TEAR_TIMEOUT 100000
+
+static unsigned int tearEnabled = 0;
+static unsigned long tearPeriod = 0; // Measured frame period (us)
+static unsigned long tearLastEdge = 0; // Time of the last vertical blank start
+static double tearPixelMicros = 0.1; // Estimated push time of a pixel (us)
+static unsigned long frameInterval = 0; // Target frame interval, 0 for no pacing
+static unsigned long frameNext = 0; // When the next frame is due
+static unsigned int frameContinued = 0; // More areas of the same frame follow
+
+static void tftglSleepMicros(unsigned long us){
+	if(us > 0)usleep(us);
+}
+
+static unsigned int tftglTearLevel(){
+	return (GPIO_READ_REG(GPIO_GPLEV0) >> LCD_TE) & 1;
+}
+
+// Waits for the start of the next vertical blank (rising edge of TE), or
+// returns right away if the scan is in it already. Returns the time the
+// vertical blank started or 0 if the TE line does not toggle.
+static unsigned long tftglWaitTearEdge(){
+	unsigned long now = tftglMicros();
+	unsigned long deadline, edge;
+
+	if(tftglTearLevel()){
+		if(tearPeriod > 0 && tearLastEdge > 0 && now - tearLastEdge < tearPeriod * 64){
+			// In the vertical blank, started at the last predicted edge
+			return tearLastEdge + ((now - tearLastEdge) / tearPeriod) * tearPeriod;
+		}
+		deadline = now + TEAR_TIMEOUT;
+		while(tftglTearLevel()){
+			if(tftglMicros() > deadline)return 0;
+		}
+	} else if(tearPeriod > 0 && tearLastEdge > 0){
+		// Sleep until shortly before the predicted edge
+		unsigned long next = tearLastEdge + ((now - tearLastEdge) / tearPeriod + 1) * tearPeriod;
+		if(next > now + TEAR_SPIN){
+			tftglSleepMicros(next - now - TEAR_SPIN);
+		}
+	}
+
+	deadline = tftglMicros() + TEAR_TIMEOUT;
+	while(!tftglTearLevel()){
+		if(tftglMicros() > deadline)return 0;
+	}
+	edge = tftglMicros();
+
+	// Follow the frame period of the display
+	if(tearLastEdge > 0 && tearPeriod > 0){
+		unsigned long frames = (edge - tearLastEdge + tearPeriod / 2) / tearPeriod;
+		if(frames > 0 && frames < 64){
+			tearPeriod = (tearPeriod * 7 + (edge - tearLastEdge) / frames) / 8;
+		}
+	} else if(tearLastEdge > 0){
+		tearPeriod = edge - tearLastEdge;
+	}
+	tearLastEdge = edge;
+	return edge;
+}
+
+// Waits until the area can be sent without tearing. The first area of a
+// frame waits for the vertical blank, the following ones are fitted into
+// the same scan.
+static void tftglWaitTear(unsigned int x, unsigned int y, unsigned int w, unsigned int h){
+	unsigned int first, last;
+	unsigned long now, edge, lineMicros, duration, reachFirst, passLast;
+
+	if(frameContinued){
+		now = tftglMicros();
+		edge = tearLastEdge + ((now - tearLastEdge) / tearPeriod) * tearPeriod;
+	} else {
+		edge = tftglWaitTearEdge();
+		if(edge == 0){
+			// The TE line is not connected (or stopped)
+			tearEnabled = 0;
+			return;
+		}
+		now = tftglMicros();
+	}
+
+	// Scan lines of the area, the scan runs along the frame memory pages
+	// (screen rows, or columns where they are exchanged), reversed by the
+	// page order and the scan flip of the SSD1963 (A0). The TE pin is the
+	// one of the first panel, the others are assumed to run in step.
+	if(displayExchange){
+		first = x % panelWidth;
+		last = first + w;
+		if(last > panelWidth){
+			first = 0;
+			last = panelWidth;
+		}
+	} else {
+		first = y;
+		last = y + h;
+	}
+	if(((displayAddressMode & 0x80) != 0) ^ (displayDriver->flipScan && !(displayAddressMode & 0x01))){
+		unsigned int t = first;
+		first = LCD_VDP - last;
+		last = LCD_VDP - t;
+	}
+
+	lineMicros = tearPeriod / LCD_VT;
+	duration = (unsigned long)(w * h * tearPixelMicros);
+	reachFirst = edge + (LCD_VT - LCD_VDP + first) * lineMicros;
+	passLast = edge + (LCD_VT - LCD_VDP + last) * lineMicros;
+
+	// Can not stay ahead of the scan, follow it once it passed the area.
+	// Areas at the bottom are sent right away as there is no time after.
+	if(now + duration > reachFirst && now < passLast && last < LCD_VDP){
+		tftglSleepMicros(passLast - now);
+	}
+}
+
+// Called before every push, waits for the next frame slot and the tear
+// effect signal. The time spent waiting goes to the stats.
+static void tftglWaitFrame(unsigned int x, unsigned int y, unsigned int w, unsigned int h){
+	unsigned long start = tftglMicros();
+
+	if(frameInterval > 0 && !frameContinued){
+		if(frameNext == 0 || start > frameNext + frameInterval){
+			// Late by more than a frame, start over from now
+			if(frameNext != 0)STATS_ADD(missedFrames, 1);
+			frameNext = start;
+		} else if(start < frameNext){
+			tftglSleepMicros(frameNext - start);
+		}
+		frameNext += frameInterval;
+	}
+
+	if(tearEnabled && tearPeriod > 0 && displayInitialized == TFTGL_OK){
+		tftglWaitTear(x, y, w, h);
+	}
+
+	STATS_ADD(waitMicros, tftglMicros() - start);
+}
+
+// Updates the push time estimate after pushing the given pixels
+static void tftglTearPushed(unsigned long pixels, unsigned long micros){
+	if(pixels < 1024)return;
+	tearPixelMicros = (tearPixelMicros * 3 + (double)micros / pixels) / 4;
+}
+
+void tftglTerminateTearSync(){
+	if(tearEnabled && displayInitialized == TFTGL_OK){
+		tftglDisplaySelect(DISPLAY_ALL_PANELS);
+		COMMAND(0x34); // Tear effect off
+	}
+	tearEnabled = 0;
+	tearPeriod = 0;
+	tearLastEdge = 0;
+}
+
+unsigned int tftglInitTearSync(unsigned int flags){
+	if(!(flags & TFTGL_TEAR_SYNC) || displayInitialized != TFTGL_OK){
+		return TFTGL_OK;
+	}
+
+	bcm2835_gpio_fsel(LCD_TE, BCM2835_GPIO_FSEL_INPT);
+	tftglDisplaySelect(DISPLAY_ALL_PANELS);
+	COMMAND(0x35); // Tear effect on
+	DATA(0x00); // Vertical blank only
+
+	// Measure the frame period from two edges
+	tearEnabled = 1;
+	tearPeriod = 0;
+	tearLastEdge = 0;
+	if(tftglWaitTearEdge() == 0 || tftglWaitTearEdge() == 0 || tearPeriod == 0){
+		tftglTerminateTearSync();
+		errorCode = TFTGL_NO_TEAR;
+		return TFTGL_ERROR;
+	}
+	return TFTGL_OK;
+}
+
+void tftglSetFrameRate(unsigned int fps){
+	frameInterval = (fps > 0 ? 1000000 / fps : 0);
+	frameNext = 0;
+}
@@ -0,0 +1,381 @@
+// Video playback: MJPEG files (JPEG images one after the other) or numbered
+// image files. A decode thread turns the frames into RGB-565 and queues
+// them, a push thread sends each one when it is due. Frames that are late
+// are dropped, before decoding if possible, so the video keeps its speed
+// when the decoding or the bus can not keep up. The frames are not turned
+// for the orientation, the address mode of the LCD does that.
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <limits.h>
+
+// Decoded frames waiting to be sent
+#define VIDEO_QUEUE 3
+
+typedef struct {
+	unsigned short* pixels;
+	unsigned int w, h;
+	unsigned long due; // When it is to be shown (us)
+} TftglVideoFrame;
+
+static pthread_t videoDecodeThread;
+static pthread_t videoPushThread;
+static pthread_mutex_t videoMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t videoCond = PTHREAD_COND_INITIALIZER;
+static unsigned int videoRunning = 0; // The threads are started
+static unsigned int videoPlaying = 0; // Until the last frame is sent
+static unsigned int videoQuit = 0;
+static unsigned int videoEnded = 0; // No more frames to decode
+static TftglVideoFrame videoFrames[VIDEO_QUEUE];
+static unsigned int videoHead = 0; // Next frame to send
+static unsigned int videoCount = 0; // Frames in the queue
+static TftglVideoStats videoStats;
+
+// The source, a mapped MJPEG file or the pattern of the image names
+static unsigned char* videoData = NULL;
+static size_t videoSize = 0;
+static char* videoPattern = NULL;
+static unsigned int videoFirst = 0; // Number of the first image
+static unsigned int videoX, videoY;
+static unsigned long videoInterval;
+static unsigned int videoLoop;
+
+// Finds the next JPEG image of the MJPEG file at *pos, from its start of
+// image marker to its end of image marker. The segments are skipped by
+// their length, so the thumbnail in the Exif data of a camera image is not
+// taken for the end. Returns 0 at the end of the file.
+static unsigned int tftglVideoNextJpeg(size_t* pos, size_t* start, size_t* size){
+	size_t i = *pos;
+	unsigned int scan = 0;
+
+	while(i + 3 <= videoSize && !(videoData[i] == 0xFF && videoData[i + 1] == 0xD8 && videoData[i + 2] == 0xFF))i++;
+	if(i + 3 > videoSize)return 0;
+	*start = i;
+
+	i += 2;
+	while(i + 2 <= videoSize){
+		unsigned int marker = videoData[i + 1];
+		if(videoData[i] != 0xFF || marker == 0xFF){
+			// Entropy coded data or fill bytes
+			i++;
+		} else if(scan && (marker == 0x00 || (marker >= 0xD0 && marker <= 0xD7))){
+			// Stuffed 0xFF or restart marker within the scan
+			i += 2;
+		} else if(marker == 0xD9){
+			i += 2;
+			break;
+		} else if(i + 4 <= videoSize){
+			// Segment with a length, a scan follows the start of scan header
+			scan = (marker == 0xDA);
+			i += 2 + ((videoData[i + 2] << 8) | videoData[i + 3]);
+		} else {
+			i = videoSize;
+		}
+	}
+	if(i > videoSize)i = videoSize;
+	*size = i - *start;
+	*pos = i;
+	return 1;
+}
+
+static unsigned int tftglVideoImageExists(unsigned int number){
+	char name[PATH_MAX];
+	snprintf(name, sizeof(name), videoPattern, number);
+	return access(name, R_OK) == 0;
+}
+
+// Converts a decoded RGB-888 image to RGB-565, cut off at the screen edges
+static void tftglVideoConvert(TftglVideoFrame* frame, const unsigned char* rgb, unsigned int w, unsigned int h){
+	unsigned int x, y;
+
+	frame->w = (videoX + w > LCD_WIDTH ? LCD_WIDTH - videoX : w);
+	frame->h = (videoY + h > LCD_HEIGHT ? LCD_HEIGHT - videoY : h);
+	for(y = 0; y < frame->h; y++){
+		const unsigned char* src = &rgb[y * w * 3];
+		unsigned short* dst = &frame->pixels[y * frame->w];
+		for(x = 0; x < frame->w; x++){
+			dst[x] = ((src[0] >> 3) << 11) | ((src[1] >> 2) << 5) | src[2] >> 3;
+			src += 3;
+		}
+	}
+}
+
+static void* tftglVideoDecodeFunc(void* arg){
+	size_t pos = 0, start = 0, size = 0;
+	unsigned int number = videoFirst;
+	unsigned int framesPass = 0; // Frames found since the start of the file
+	unsigned long decoded = 0;
+	unsigned long n = 0, begin = 0;
+	int quit;
+	(void)arg;
+
+	while(1){
+		TftglVideoFrame* frame;
+		unsigned char* rgb;
+		unsigned long now, due, decodeMicros;
+		int w, h, channels;
+		unsigned int available;
+
+		pthread_mutex_lock(&videoMutex);
+		if(videoQuit){
+			pthread_mutex_unlock(&videoMutex);
+			break;
+		}
+		pthread_mutex_unlock(&videoMutex);
+
+		if(videoData != NULL){
+			available = tftglVideoNextJpeg(&pos, &start, &size);
+		} else {
+			available = tftglVideoImageExists(number);
+		}
+		if(!available){
+			// Start over, unless nothing could be decoded at all
+			if(!videoLoop || framesPass == 0 || decoded == 0)break;
+			pos = 0;
+			number = videoFirst;
+			framesPass = 0;
+			continue;
+		}
+		framesPass++;
+
+		// Skip the frames that would be late anyway, the time starts with the
+		// first frame
+		now = tftglMicros();
+		due = begin + n * videoInterval;
+		if(n > 0 && now > due + videoInterval){
+			pthread_mutex_lock(&videoMutex);
+			videoStats.dropped++;
+			pthread_mutex_unlock(&videoMutex);
+			n++;
+			number++;
+			continue;
+		}
+
+		if(videoData != NULL){
+			rgb = stbi_load_from_memory(&videoData[start], size, &w, &h, &channels, 3);
+		} else {
+			char name[PATH_MAX];
+			snprintf(name, sizeof(name), videoPattern, number);
+			rgb = stbi_load(name, &w, &h, &channels, 3);
+		}
+		decodeMicros = tftglMicros() - now;
+		number++;
+		if(rgb == NULL){
+			pthread_mutex_lock(&videoMutex);
+			videoStats.dropped++;
+			pthread_mutex_unlock(&videoMutex);
+			n++;
+			continue;
+		}
+
+		// Wait for a free frame, only this thread writes it
+		pthread_mutex_lock(&videoMutex);
+		while(videoCount == VIDEO_QUEUE && !videoQuit){
+			pthread_cond_wait(&videoCond, &videoMutex);
+		}
+		frame = &videoFrames[(videoHead + videoCount) % VIDEO_QUEUE];
+		quit = videoQuit;
+		pthread_mutex_unlock(&videoMutex);
+		if(quit){
+			stbi_image_free(rgb);
+			break;
+		}
+
+		now = tftglMicros();
+		tftglVideoConvert(frame, rgb, w, h);
+		stbi_image_free(rgb);
+		decodeMicros += tftglMicros() - now;
+		if(n == 0)begin = tftglMicros();
+		frame->due = begin + n * videoInterval;
+		n++;
+		decoded++;
+
+		pthread_mutex_lock(&videoMutex);
+		videoStats.decoded++;
+		videoStats.decodeMicros += decodeMicros;
+		videoCount++;
+		pthread_cond_broadcast(&videoCond);
+		pthread_mutex_unlock(&videoMutex);
+	}
+
+	pthread_mutex_lock(&videoMutex);
+	videoEnded = 1;
+	pthread_cond_broadcast(&videoCond);
+	pthread_mutex_unlock(&videoMutex);
+	return NULL;
+}
+
+static void* tftglVideoPushFunc(void* arg){
+	TftglVideoFrame* frame;
+	unsigned long now, start;
+	(void)arg;
+
+	pthread_mutex_lock(&videoMutex);
+	while(1){
+		while(videoCount == 0 && !videoEnded && !videoQuit){
+			pthread_cond_wait(&videoCond, &videoMutex);
+		}
+		if(videoQuit || videoCount == 0)break;
+
+		// Only the newest frame that is due is worth sending
+		now = tftglMicros();
+		while(videoCount > 1 && videoFrames[(videoHead + 1) % VIDEO_QUEUE].due <= now){
+			videoHead = (videoHead + 1) % VIDEO_QUEUE;
+			videoCount--;
+			videoStats.dropped++;
+			pthread_cond_broadcast(&videoCond);
+		}
+		frame = &videoFrames[videoHead];
+		pthread_mutex_unlock(&videoMutex);
+
+		if(frame->due > now){
+			tftglSleepMicros(frame->due - now);
+		}
+		if(tearEnabled && tearPeriod > 0 && displayInitialized == TFTGL_OK){
+			tftglWaitTear(videoX, videoY, frame->w, frame->h);
+		}
+		start = tftglMicros();
+		tftglDisplayPush565(videoX, videoY, frame->w, frame->h, frame->pixels, frame->w);
+		tftglInvalidateFrameDiff(videoX, videoY, frame->w, frame->h);
+		tftglDisplayShow();
+
+		pthread_mutex_lock(&videoMutex);
+		videoStats.pushMicros += tftglMicros() - start;
+		videoStats.shown++;
+		videoHead = (videoHead + 1) % VIDEO_QUEUE;
+		videoCount--;
+		pthread_cond_broadcast(&videoCond);
+	}
+	videoPlaying = 0;
+	pthread_mutex_unlock(&videoMutex);
+	return NULL;
+}
+
+void tftglStopVideo(){
+	unsigned int i;
+
+	if(videoRunning){
+		pthread_mutex_lock(&videoMutex);
+		videoQuit = 1;
+		pthread_cond_broadcast(&videoCond);
+		pthread_mutex_unlock(&videoMutex);
+		pthread_join(videoDecodeThread, NULL);
+		pthread_join(videoPushThread, NULL);
+		videoRunning = 0;
+		videoPlaying = 0;
+	}
+	for(i = 0; i < VIDEO_QUEUE; i++){
+		free(videoFrames[i].pixels);
+		videoFrames[i].pixels = NULL;
+	}
+	if(videoData != NULL){
+		munmap(videoData, videoSize);
+		videoData = NULL;
+	}
+	free(videoPattern);
+	videoPattern = NULL;
+}
+
+// Maps the MJPEG file, or finds the first image of a pattern
+static unsigned int tftglVideoOpen(const char* filename){
+	size_t pos = 0, start, size;
+
+	if(strchr(filename, '%') != NULL){
+		videoPattern = strdup(filename);
+		if(videoPattern == NULL){
+			errorCode = TFTGL_OUT_OF_MEM;
+			return TFTGL_ERROR;
+		}
+		for(videoFirst = 0; videoFirst < 2; videoFirst++){
+			if(tftglVideoImageExists(videoFirst))return TFTGL_OK;
+		}
+	} else {
+		struct stat st;
+		int fd = open(filename, O_RDONLY);
+		if(fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0){
+			videoData = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			videoSize = st.st_size;
+			if(videoData == MAP_FAILED)videoData = NULL;
+		}
+		if(fd >= 0)close(fd);
+		if(videoData != NULL && tftglVideoNextJpeg(&pos, &start, &size))return TFTGL_OK;
+	}
+	errorCode = TFTGL_BAD_IMAGE;
+	return TFTGL_ERROR;
+}
+
+unsigned int tftglPlayVideo(const char* filename, unsigned int x, unsigned int y, unsigned int fps, unsigned int loop){
+	unsigned int i;
+
+	tftglStopVideo();
+	if(filename == NULL || fps == 0 || x >= LCD_WIDTH || y >= LCD_HEIGHT){
+		errorCode = TFTGL_BAD_IMAGE;
+		return TFTGL_ERROR;
+	}
+	if(tftglVideoOpen(filename) != TFTGL_OK){
+		tftglStopVideo();
+		return TFTGL_ERROR;
+	}
+
+	// Frames larger than the screen are cut off when decoded
+	for(i = 0; i < VIDEO_QUEUE; i++){
+		videoFrames[i].pixels = malloc((LCD_WIDTH - x) * (LCD_HEIGHT - y) * sizeof(unsigned short));
+		if(videoFrames[i].pixels == NULL){
+			tftglStopVideo();
+			errorCode = TFTGL_OUT_OF_MEM;
+			return TFTGL_ERROR;
+		}
+	}
+
+	// The bus is shared with the upload thread
+	tftglWaitUpload();
+
+	videoX = x;
+	videoY = y;
+	videoInterval = 1000000 / fps;
+	videoLoop = loop;
+	videoHead = videoCount = 0;
+	videoQuit = videoEnded = 0;
+	// Set before the push thread starts, which clears it at the end
+	videoPlaying = 1;
+	memset(&videoStats, 0, sizeof(TftglVideoStats));
+
+	if(pthread_create(&videoDecodeThread, NULL, tftglVideoDecodeFunc, NULL) != 0){
+		videoPlaying = 0;
+		tftglStopVideo();
+		errorCode = TFTGL_ERROR;
+		return TFTGL_ERROR;
+	}
+	if(pthread_create(&videoPushThread, NULL, tftglVideoPushFunc, NULL) != 0){
+		// The decode thread may wait for a free frame already
+		pthread_mutex_lock(&videoMutex);
+		videoQuit = 1;
+		videoPlaying = 0;
+		pthread_cond_broadcast(&videoCond);
+		pthread_mutex_unlock(&videoMutex);
+		pthread_join(videoDecodeThread, NULL);
+		tftglStopVideo();
+		errorCode = TFTGL_ERROR;
+		return TFTGL_ERROR;
+	}
+	videoRunning = 1;
+	return TFTGL_OK;
+}
+
+unsigned int tftglIsVideoPlaying(){
+	unsigned int playing;
+	pthread_mutex_lock(&videoMutex);
+	playing = videoPlaying;
+	pthread_mutex_unlock(&videoMutex);
+	return (playing ? TFTGL_OK : TFTGL_ERROR);
+}
+
+void tftglGetVideoStats(TftglVideoStats* dst){
+	pthread_mutex_lock(&videoMutex);
+	if(dst != NULL){
+		*dst = videoStats;
+	}
+	memset(&videoStats, 0, sizeof(TftglVideoStats));
+	pthread_mutex_unlock(&videoMutex);
+}